@@ -62,6 +62,12 @@
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * Maximum heap size in bytes of the shared library build (libmm.so). The
+ * address space is reserved up front but only touched pages use memory.
+ */
+#define SHARED_MAX_HEAP ((size_t)1 << (sizeof(void *) == 8 ? 36 : 30))
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
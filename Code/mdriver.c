@@ -73,6 +73,16 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* The entry points of one variant of the mm package */
+typedef struct {
+    char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    int (*check)(size_t budget);
+} mm_variant_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -101,6 +111,41 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* 
+ * The variants of mm.c built with other placement policies. The Makefile
+ * passes their names as MM_VARIANT_ENTRY(name) MM_VARIANT_ENTRY(name)...
+ */
+#ifndef MM_VARIANTS
+#define MM_VARIANTS
+#endif
+
+#define MM_VARIANT_ENTRY(name) \
+    int name##_mm_init(void); \
+    void *name##_mm_malloc(size_t size); \
+    void name##_mm_free(void *ptr); \
+    void *name##_mm_realloc(void *ptr, size_t size); \
+    int name##_mm_check_slice(size_t budget);
+MM_VARIANTS
+#undef MM_VARIANT_ENTRY
+
+static mm_variant_t mm_variants[] = {
+    {"mm", mm_init, mm_malloc, mm_free, mm_realloc, mm_check_slice},
+#define MM_VARIANT_ENTRY(name) \
+    {#name, name##_mm_init, name##_mm_malloc, name##_mm_free, name##_mm_realloc, \
+     name##_mm_check_slice},
+    MM_VARIANTS
+#undef MM_VARIANT_ENTRY
+};
+static int num_variants = sizeof(mm_variants) / sizeof(mm_variant_t);
+
+/* The mm package being evaluated */
+static mm_variant_t *mm_pkg = &mm_variants[0];
+
+/* With -c <n> the incremental checker of the package checks CHECK_BUDGET
+   blocks every n operations of the correctness and speed runs */
+#define CHECK_BUDGET 32
+static unsigned check_period = 0;
+
 
 /********************* 
  * Function prototypes 
@@ -125,6 +170,7 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_package(char **tracefiles, int num_tracefiles, int autograder);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
@@ -143,23 +189,18 @@ int main(int argc, char **argv)
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
-    stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
-
-    /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
-    int numcorrect;
+    int run_variants = 0;/* If set, run every variant of mm (set by -m) */
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "c:f:t:hvVgalm")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -185,6 +226,15 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'm': /* Run every variant of the mm package */
+            run_variants = 1;
+            break;
+        case 'c': /* Run the incremental heap checker every n operations */
+            if ((check_period = atoi(optarg)) == 0) {
+		usage();
+		exit(1);
+	    }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -274,6 +324,42 @@ int main(int argc, char **argv)
 	}
     }
 
+    /* Initialize the simulated memory system in memlib.c */
+    mem_init(); 
+
+    /*
+     * Always run and evaluate the student's mm package, and with -m the
+     * other variants of it that were built into mdriver as well
+     */
+    for (i = 0; i < (run_variants ? num_variants : 1); i++) {
+	mm_pkg = &mm_variants[i];
+	if (run_variants)
+	    printf("\nVariant %s:\n", mm_pkg->name);
+	eval_mm_package(tracefiles, num_tracefiles, autograder);
+    }
+
+    exit(0);
+}
+
+
+/*
+ * eval_mm_package - Evaluate the mm package selected by mm_pkg on every
+ *     trace and print its performance index
+ */
+static void eval_mm_package(char **tracefiles, int num_tracefiles, int autograder)
+{
+    int i;
+    trace_t *trace = NULL;     /* stores a single trace file in memory */
+    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
+    stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+
+    /* temporaries used to compute the performance index */
+    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    int numcorrect;
+
+    errors = 0;
+
     /*
      * Always run and evaluate the student's mm package
      */
@@ -285,9 +371,6 @@ int main(int argc, char **argv)
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
     
-    /* Initialize the simulated memory system in memlib.c */
-    mem_init(); 
-
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
 	trace = read_trace(tracedir, tracefiles[i]);
@@ -363,7 +446,7 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    free(mm_stats);
 }
 
 
@@ -604,7 +687,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm_pkg->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -619,7 +702,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = mm_pkg->malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -648,7 +731,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm_pkg->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -686,13 +769,18 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm_pkg->free(p);
 	    break;
 
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 
+	if (check_period && (i + 1) % check_period == 0 &&
+	    mm_pkg->check(CHECK_BUDGET) > 0) {
+	    malloc_error(tracenum, i, "mm_check_slice found the heap inconsistent.");
+	    return 0;
+	}
     }
 
     /* As far as we know, this is a valid malloc package */
@@ -726,7 +814,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (mm_pkg->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -736,7 +824,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm_pkg->malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -758,7 +846,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm_pkg->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -779,7 +867,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm_pkg->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -809,17 +897,19 @@ static void eval_mm_speed(void *ptr)
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (mm_pkg->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
+    for (i = 0;  i < trace->num_ops;  i++) {
+	if (check_period && i % check_period == 0)
+	    mm_pkg->check(CHECK_BUDGET);
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_pkg->malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -828,7 +918,7 @@ static void eval_mm_speed(void *ptr)
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = mm_pkg->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -836,12 +926,13 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm_pkg->free(block);
             break;
 
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
+    }
 }
 
 /*
@@ -1025,13 +1116,15 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValm] [-c <n>] [-f <file>] [-t <dir>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-c <n>     Check part of the heap every <n> operations.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-m         Run every variant of mm built into mdriver.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
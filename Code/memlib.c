@@ -2,6 +2,11 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            Built with -DMEM_MMAP (as for libmm.so) the storage is mapped
+ *            from the kernel instead of taken from libc malloc, and the
+ *            heap may grow up to SHARED_MAX_HEAP bytes.  Pages of the
+ *            mapping only use memory once they are touched.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,10 +19,52 @@
 #include "memlib.h"
 #include "config.h"
 
+/* A simulated heap: the storage backing it and its brk pointer */
+struct mem_region {
+    char *start_brk;  /* points to first byte of heap */
+    char *brk;        /* points to last byte of heap */
+    char *max_addr;   /* largest legal heap address */ 
+};
+
+/* Regions from mem_region_create keep their descriptor in front of the heap */
+#define REGION_HDR_SIZE ((sizeof(struct mem_region) + 15) & ~(size_t)15)
+
+#ifdef MEM_MMAP
+#define MEM_MAX_HEAP SHARED_MAX_HEAP
+#else
+#define MEM_MAX_HEAP MAX_HEAP
+#endif
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static struct mem_region mem_heap;  /* the region behind mem_sbrk */
+static char *mem_storage;           /* storage of mem_heap */
+
+/*
+ * storage_alloc - get the storage for a region of size bytes, NULL on failure
+ */
+static void *storage_alloc(size_t size)
+{
+#ifdef MEM_MMAP
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (p == MAP_FAILED) ? NULL : p;
+#else
+    return malloc(size);
+#endif
+}
+
+/*
+ * storage_free - give back the storage from storage_alloc
+ */
+static void storage_free(void *p, size_t size)
+{
+#ifdef MEM_MMAP
+    munmap(p, size);
+#else
+    (void)size;
+    free(p);
+#endif
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -25,13 +72,14 @@ static char *mem_max_addr;   /* largest legal heap address */
 void mem_init(void)
 {
     /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
+    if ((mem_storage = (char *)storage_alloc(MEM_MAX_HEAP)) == NULL) {
 	fprintf(stderr, "mem_init_vm: malloc error\n");
 	exit(1);
     }
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_heap.start_brk = mem_storage;
+    mem_heap.max_addr = mem_storage + MEM_MAX_HEAP;  /* max legal heap address */
+    mem_heap.brk = mem_storage;                  /* heap is empty initially */
 }
 
 /* 
@@ -39,7 +87,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    storage_free(mem_storage, MEM_MAX_HEAP);
 }
 
 /*
@@ -47,25 +95,26 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_region_reset_brk(&mem_heap);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
  *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    this model, the heap is only shrunk by mem_trim.
  */
 void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    return mem_region_sbrk(&mem_heap, incr);
+}
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+/*
+ * mem_trim - shrink the heap by decr bytes, the opposite of mem_sbrk.
+ *    Returns 0 on success and -1 if the heap is smaller than that.
+ */
+int mem_trim(size_t decr)
+{
+    return mem_region_trim(&mem_heap, decr);
 }
 
 /*
@@ -73,7 +122,7 @@ void *mem_sbrk(intptr_t incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_region_lo(&mem_heap);
 }
 
 /* 
@@ -81,7 +130,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_region_hi(&mem_heap);
 }
 
 /*
@@ -89,7 +138,15 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_region_size(&mem_heap);
+}
+
+/*
+ * mem_maxheapsize() - returns the most bytes the heap can grow to
+ */
+size_t mem_maxheapsize()
+{
+    return MEM_MAX_HEAP;
 }
 
 /*
@@ -99,3 +156,98 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_region_create - create an independent region that can grow up to
+ *    max_size bytes. Returns NULL if the storage can't be allocated.
+ */
+mem_region_t *mem_region_create(size_t max_size)
+{
+    struct mem_region *region;
+
+    if ((region = (struct mem_region *)storage_alloc(REGION_HDR_SIZE + max_size)) == NULL)
+	return NULL;
+
+    region->start_brk = (char *)region + REGION_HDR_SIZE;
+    region->max_addr = region->start_brk + max_size;
+    region->brk = region->start_brk;
+    return region;
+}
+
+/*
+ * mem_region_destroy - free a region and everything allocated in it
+ */
+void mem_region_destroy(mem_region_t *region)
+{
+    storage_free(region, (size_t)(region->max_addr - (char *)region));
+}
+
+/* 
+ * mem_region_sbrk - mem_sbrk on the given region
+ */
+void *mem_region_sbrk(mem_region_t *region, intptr_t incr) 
+{
+    char *old_brk = region->brk;
+
+    if ( (incr < 0) || ((region->brk + incr) > region->max_addr)) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    region->brk += incr;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_region_trim - mem_trim on the given region.  With mapped storage the
+ *    whole pages above the new brk are given back to the kernel.
+ */
+int mem_region_trim(mem_region_t *region, size_t decr)
+{
+    if (decr > (size_t)(region->brk - region->start_brk))
+	return -1;
+    region->brk -= decr;
+#ifdef MEM_MMAP
+    {
+	size_t pagesize = mem_pagesize();
+	char *start = (char *)(((uintptr_t)region->brk + pagesize - 1) & ~(uintptr_t)(pagesize - 1));
+	char *end = (char *)((uintptr_t)(region->brk + decr) & ~(uintptr_t)(pagesize - 1));
+
+	if (start < end)
+	    madvise(start, (size_t)(end - start), MADV_DONTNEED);
+    }
+#endif
+    return 0;
+}
+
+/*
+ * mem_region_reset_brk - make the region empty again
+ */
+void mem_region_reset_brk(mem_region_t *region)
+{
+    region->brk = region->start_brk;
+}
+
+/*
+ * mem_region_lo - return address of the first byte of the region's heap
+ */
+void *mem_region_lo(mem_region_t *region)
+{
+    return (void *)region->start_brk;
+}
+
+/* 
+ * mem_region_hi - return address of last byte of the region's heap
+ */
+void *mem_region_hi(mem_region_t *region)
+{
+    return (void *)(region->brk - 1);
+}
+
+/*
+ * mem_region_size - returns the size of the region's heap in bytes
+ */
+size_t mem_region_size(mem_region_t *region) 
+{
+    return (size_t)(region->brk - region->start_brk);
+}
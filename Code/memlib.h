@@ -1,8 +1,38 @@
+#ifndef __MEMLIB_H_
+#define __MEMLIB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(intptr_t incr);
+int mem_trim(size_t decr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_maxheapsize(void);
 size_t mem_pagesize(void);
+
+/* Independent regions, each with its own brk pointer and storage */
+typedef struct mem_region mem_region_t;
+
+mem_region_t *mem_region_create(size_t max_size);
+void mem_region_destroy(mem_region_t *region);
+void *mem_region_sbrk(mem_region_t *region, intptr_t incr);
+int mem_region_trim(mem_region_t *region, size_t decr);
+void mem_region_reset_brk(mem_region_t *region);
+void *mem_region_lo(mem_region_t *region);
+void *mem_region_hi(mem_region_t *region);
+size_t mem_region_size(mem_region_t *region);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MEMLIB_H_ */
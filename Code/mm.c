@@ -7,6 +7,7 @@
  * Simple, 32-bit and 64-bit clean allocator based on an segregated free lists. 
  * Segregated fits approach  
  * LIFO ordering and Pseudo best fit placement policy used in each of the individual free lists which are implemented as explicit lists.
+ * The policies are macros (MAX_SUITABLE, LIST_ORDER, SPLIT_THRESHOLD, SPLIT_DIRECTION, MAXSIZE_CLASS_0, CLASS_RATIO, FREE_INDEX, ADAPTIVE_CLASSES) which can be overridden at compile time.
  * Boundary tag coalescing. 
  * Inplace reallocation is used wherever possible.
  * 
@@ -21,13 +22,19 @@
  *
  */
 
+#define _GNU_SOURCE			/* for dladdr */
+#include <dlfcn.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "memlib.h"
 #include "mm.h"
+#include "mm_snapshot.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -52,23 +59,137 @@ team_t team = {
 #define CHUNKSIZE  (1 << 12)      /* Extend heap by this amount (bytes) */
 
 
+/*
+ * Placement policies.  Each one can be overridden at compile time (see the
+ * variants in the Makefile), the defaults are the ones described in
+ * writeup.txt.
+ */
+
+/* Upper bounds of the segregation classes: the smallest one, then each class is CLASS_RATIO times the previous one. */
+#ifndef MAXSIZE_CLASS_0
 #define MAXSIZE_CLASS_0 (8 * WSIZE)
-#define MAXSIZE_CLASS_1 (16 * WSIZE)
-#define MAXSIZE_CLASS_2 (32 * WSIZE)
-#define MAXSIZE_CLASS_3 (64 * WSIZE)
-#define MAXSIZE_CLASS_4 (128 * WSIZE)
-#define MAXSIZE_CLASS_5 (256 * WSIZE)
-#define MAXSIZE_CLASS_6 (512 * WSIZE)
-#define MAXSIZE_CLASS_7 (1024 * WSIZE)
-#define MAXSIZE_CLASS_8 (2048 * WSIZE)
-#define MAXSIZE_CLASS_9 (4096 * WSIZE)
+#endif
+#ifndef CLASS_RATIO
+#define CLASS_RATIO 2
+#endif
+#define MAXSIZE_CLASS_1 (MAXSIZE_CLASS_0 * CLASS_RATIO)
+#define MAXSIZE_CLASS_2 (MAXSIZE_CLASS_1 * CLASS_RATIO)
+#define MAXSIZE_CLASS_3 (MAXSIZE_CLASS_2 * CLASS_RATIO)
+#define MAXSIZE_CLASS_4 (MAXSIZE_CLASS_3 * CLASS_RATIO)
+#define MAXSIZE_CLASS_5 (MAXSIZE_CLASS_4 * CLASS_RATIO)
+#define MAXSIZE_CLASS_6 (MAXSIZE_CLASS_5 * CLASS_RATIO)
+#define MAXSIZE_CLASS_7 (MAXSIZE_CLASS_6 * CLASS_RATIO)
+#define MAXSIZE_CLASS_8 (MAXSIZE_CLASS_7 * CLASS_RATIO)
+#define MAXSIZE_CLASS_9 (MAXSIZE_CLASS_8 * CLASS_RATIO)
+
+/* Pseudo best fit stops once more than MAX_SUITABLE fitting blocks were seen, 0 makes it first fit. */
+#ifndef MAX_SUITABLE
+#define MAX_SUITABLE 5
+#endif
+
+/* Where a freed block goes in its segregated list. */
+#define LIST_ORDER_LIFO 0		/* at the front */
+#define LIST_ORDER_FIFO 1		/* at the back */
+#define LIST_ORDER_ADDRESS 2		/* lists sorted by address, so fits are taken from the bottom of the heap */
+#ifndef LIST_ORDER
+#define LIST_ORDER LIST_ORDER_LIFO
+#endif
+
+/* A block is split when at least this many bytes would be left over, never less than the minimum block size. */
+#ifndef SPLIT_THRESHOLD
+#define SPLIT_THRESHOLD (2 * DSIZE)
+#endif
+
+/* Which end of a free block an allocation is taken from when the block is split.  Taking large blocks from the
+ * end keeps them apart from the small ones taken from the start, so that a freed large block can coalesce with
+ * its free neighbours instead of being pinned between small live ones. */
+#define SPLIT_DIRECTION_LOW 0		/* always the start */
+#define SPLIT_DIRECTION_BY_SIZE 1	/* the end for blocks of SPLIT_LARGE_SIZE bytes or more */
+#ifndef SPLIT_DIRECTION
+#define SPLIT_DIRECTION SPLIT_DIRECTION_LOW
+#endif
+#ifndef SPLIT_LARGE_SIZE
+#define SPLIT_LARGE_SIZE MAXSIZE_CLASS_1
+#endif
 
 #define NO_SEG_CLASSES 10
+#if NO_SEG_CLASSES != MM_STATS_CLASSES
+#error "mm_stats reports MM_STATS_CLASSES classes"
+#endif
+
+/* With FREE_INDEX the free blocks of each class are kept in two arrays, of their sizes and of their addresses,
+ * in a memlib region outside the heap instead of in the lists, so a fit search reads contiguous memory rather
+ * than the header and links of every block it looks at.  A free block keeps its slot in the arrays in its
+ * first word. */
+#ifndef FREE_INDEX
+#define FREE_INDEX 0
+#endif
+#if FREE_INDEX && LIST_ORDER != LIST_ORDER_LIFO
+#error "FREE_INDEX replaces the free lists, LIST_ORDER does not apply to it"
+#endif
+
+/* With ADAPTIVE_CLASSES the MAXSIZE_CLASS_* bounds are only the starting point.  The heap counts the sizes it is
+ * asked for in HIST_BUCKETS buckets of DSIZE bytes (the last bucket takes all larger sizes).  Every ADAPT_PERIOD
+ * requests it adds the sizes of its free blocks to the counts and moves the bounds so that each class gets an equal
+ * share of them, then puts the free blocks in the lists of their new classes.  The counts are halved each time so
+ * they follow a changing workload. */
+#ifndef ADAPTIVE_CLASSES
+#define ADAPTIVE_CLASSES 0
+#endif
+#define HIST_BUCKETS 512
+#define ADAPT_PERIOD 4096
+#if ADAPTIVE_CLASSES && FREE_INDEX
+#error "the free block index is sized from the fixed class bounds, ADAPTIVE_CLASSES does not apply to it"
+#endif
+
+/* With MM_STATS each heap keeps the counters reported by mm_stats up to date as it goes; 0 compiles them out. */
+#ifndef MM_STATS
+#define MM_STATS 1
+#endif
+#if MM_STATS
+#define STAT(update) (update)
+#else
+#define STAT(update) ((void)0)
+#endif
+
+/* Words at the start of the heap for the list heads, FIFO lists also keep their tails after the heads. */
+#if LIST_ORDER == LIST_ORDER_FIFO
+#define NO_LIST_WORDS (2 * NO_SEG_CLASSES)
+#define SEG_TAIL(class) (heap->segregation_classes[NO_SEG_CLASSES + (class)])
+#elif LIST_ORDER == LIST_ORDER_ADDRESS
+/* An address ordered list is the bottom level of a skip list.  Once the list has more than SKIP_MIN blocks, a
+ * block added to it gets a tower of express links with probability 1/4, which reaches one level higher with each
+ * further chance of 1/4, up to SKIP_LEVELS - 1 levels above the list but at most one above the highest tower of
+ * the class (Pugh's fix of the dice).  An insertion goes down the towers to the last one below the block and walks
+ * the list from there, about four blocks, so it takes O(log n) in the length of the list, as does the removal of a
+ * block with a tower; the others are unlinked in O(1), and short lists are just walked.  The heads of the levels of
+ * each class follow the heads of the lists.  The smallest blocks have no room for a tower, so towers are kept in
+ * memlib regions of SKIP_CHUNK towers each, made as they are needed; the first slot of a region holds the address
+ * of the region made before it. */
+#define SKIP_LEVELS 8
+#define SKIP_MIN 16
+#define SKIP_CHUNK 1024
+#define NO_LIST_WORDS (NO_SEG_CLASSES * SKIP_LEVELS)
+#define SEG_SKIP(class) ((struct skip_tower **)&heap->segregation_classes[NO_SEG_CLASSES + (class) * (SKIP_LEVELS - 1)])
+#else
+#define NO_LIST_WORDS NO_SEG_CLASSES
+#endif
 
 #define MAX(x, y)  ((x) > (y) ? (x) : (y))  
 #define MIN(x, y)  ((x) < (y) ? (x) : (y))  
 
 
+/* The tag of an mm_malloc_tagged block is kept in the top TAG_BITS bits of its header and footer, which no
+ * block size reaches.  Tag 0 is an untagged block. */
+#if UINTPTR_MAX > 0xffffffffu
+#define TAG_BITS 8
+#else
+#define TAG_BITS 4			/* leaves room for blocks up to 256 MB */
+#endif
+#define TAG_SHIFT (8 * sizeof(uintptr_t) - TAG_BITS)
+#define TAG_MASK ((((uintptr_t)1 << TAG_BITS) - 1) << TAG_SHIFT)
+#define NO_TAGS (1 << TAG_BITS)
+
 /* Pack a size and allocated bit into a word. */
 #define PACK(size, alloc)  ((size) | (alloc))
 
@@ -76,9 +197,15 @@ team_t team = {
 #define GET(p)       (*(uintptr_t *)(p))
 #define PUT(p, val)  (*(uintptr_t *)(p) = (val))
 
-/* Read the size and allocated fields from address p. */
-#define GET_SIZE(p)   (GET(p) & ~(DSIZE - 1))
+/* Bits of a header which are not its size: the flags below DSIZE, FREED and the tag.  MAX_BLOCK_SIZE is the
+ * largest size the other bits hold. */
+#define FLAG_MASK (TAG_MASK | (DSIZE - 1) | FREED)
+#define MAX_BLOCK_SIZE ((size_t)~FLAG_MASK)
+
+/* Read the size, allocated and tag fields from address p. */
+#define GET_SIZE(p)   (GET(p) & ~FLAG_MASK)
 #define GET_ALLOC(p)  (GET(p) & 0x1)
+#define GET_TAG(p)    ((unsigned int)((GET(p) & TAG_MASK) >> TAG_SHIFT))
 
 /* Given block ptr bp, compute address of its header and footer. */
 #define HDRP(bp)  ((char *)(bp) - WSIZE)
@@ -96,22 +223,396 @@ team_t team = {
 #define EXP_SET_NEXT_BLKP(bp, next_block_ptr) PUT((unsigned int**)(bp) + 1, next_block_ptr)
 #define EXP_SET_PREV_BLKP(bp, prev_block_ptr) PUT((unsigned int**)bp, prev_block_ptr) 
 
+/* Slot of a free block in the free block index */
+#define INDEX_SLOT(bp) GET(bp)
+#define SET_INDEX_SLOT(bp, slot) PUT(bp, slot)
+
+#if MM_STATS
+/* Counters of one heap, see mm_stats. */
+struct heap_counters {
+	size_t free_bytes[NO_SEG_CLASSES];	/* bytes of the free blocks of each class */
+	size_t free_blocks[NO_SEG_CLASSES];
+	size_t largest[NO_SEG_CLASSES];		/* size of the largest free block of each class */
+	bool largest_left[NO_SEG_CLASSES];	/* that block has left the class, mm_stats looks for the next one */
+	unsigned long splits;			/* free blocks split by a placement */
+	unsigned long coalesces;		/* free blocks merged with a neighbour */
+	unsigned long extends;			/* calls of extend_heap that got memory */
+};
+#endif
+
+/* State of one heap: the default heap or one made by mm_heap_create. */
+struct mm_heap {
+	char *heap_listp; /* Pointer to first block */  
+	unsigned int** segregation_classes;	/*used to keep reference of the segregation classes */
+	mem_region_t *region;			/* memlib region behind the heap, NULL for the mem_sbrk heap */
+#if FREE_INDEX
+	mem_region_t *index_region;		/* memlib region holding the free block index */
+	struct index_class *index;		/* the arrays of each class, at the start of index_region */
+	size_t max_size;			/* most memory the heap may take, the arrays are sized from it */
+#endif
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+	mem_region_t *tower_region;		/* newest region of skip list towers, NULL before the first */
+	struct skip_tower *free_towers;		/* towers of blocks which have left their lists */
+	size_t list_length[NO_SEG_CLASSES];	/* blocks in the list of each class */
+	unsigned char skip_top[NO_SEG_CLASSES];	/* levels above the list with towers in them, per class */
+#endif
+#if ADAPTIVE_CLASSES
+	size_t class_limits[NO_SEG_CLASSES - 1];	/* largest block size of each class but the last */
+	unsigned int hist[HIST_BUCKETS];	/* requests counted per size since the counts were last halved */
+	unsigned int requests;			/* requests since the bounds were last moved */
+#endif
+#if MM_STATS
+	struct heap_counters stats;
+#endif
+};
+
+#if FREE_INDEX
+/* Free blocks of one class in the free block index. */
+struct index_class {
+	size_t count;				/* number of free blocks */
+	size_t *sizes;				/* sizes[i] is the size of blocks[i] */
+	void **blocks;
+};
+#endif
+
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+/* Tower of a free block in an address ordered list: next[i] is the next tower of the class reaching level i + 1.
+ * A free tower is linked through next[0].  The block carries SKIP_TOWER in its header and footer; free blocks are
+ * never MOVABLE, so the bit is free for it. */
+struct skip_tower {
+	void *block;
+	struct skip_tower *next[SKIP_LEVELS - 1];
+};
+
+#define SKIP_TOWER MOVABLE
+#endif
+
+/* Space taken by the descriptor of an mm_heap_create heap at the start of its region */
+#define HEAP_DESC_SIZE  (DSIZE * ((sizeof(struct mm_heap) + DSIZE - 1) / DSIZE))
+
+/* A chunk of a region, it starts with this header and is an allocated block of the heap. */
+struct region_chunk {
+	struct region_chunk *prev;	/* chunk taken before this one */
+	char *limit;			/* first byte after the chunk */
+};
+
+/* Bump pointer region made by mm_region_create. */
+struct mm_region {
+	struct region_chunk *chunk;	/* chunk being bumped */
+	char *top;			/* next free byte of the chunk */
+	size_t chunk_size;		/* payload size of a new chunk */
+};
+
+#define REGION_HDR_SIZE  (DSIZE * ((sizeof(struct region_chunk) + DSIZE - 1) / DSIZE))
+
+/* A slab of an object cache.  The slab is aligned to the slab size of its cache, so the slab of an
+ * object is found by masking the object's address.  The header is followed by the stack of the
+ * indexes of the free objects and then by the objects. */
+struct cache_slab {
+	struct cache_slab *prev;	/* neighbours in the partial or full list of the cache */
+	struct cache_slab *next;
+	unsigned int nfree;		/* number of entries in the free index stack */
+	unsigned int free[];		/* indexes of the free (but constructed) objects */
+};
+
+/* Object cache made by mm_cache_create. */
+struct mm_cache {
+	size_t size;			/* object size, a multiple of align */
+	size_t slab_size;		/* power of two, slabs are aligned to it */
+	size_t objs_offset;		/* offset of the first object in a slab */
+	unsigned int objs_per_slab;
+	void (*ctor)(void *);
+	void (*dtor)(void *);
+	struct cache_slab *partial;	/* slabs with free objects */
+	struct cache_slab *full;	/* slabs without free objects */
+	struct mm_cache *next;		/* next cache in the list of all caches */
+};
+
+#define CACHE_MIN_OBJS  8		/* a slab holds at least this many objects */
+
+#if FREE_INDEX
+/* The index search compares a vector of sizes at a time where the processor allows it, see best_fit_dispatch. */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define INDEX_SIMD 1
+#include <immintrin.h>
+#else
+#define INDEX_SIMD 0
+#endif
+#endif
+
+/* Lifetime prediction for mm_malloc_site.  Every SAMPLE_PERIOD-th block allocated through a site is sampled: it is
+ * marked with the SAMPLED bit in its header and footer and its birth, counted in site allocations, is kept in
+ * "samples" until it is freed.  A site whose sampled blocks lived less than SHORT_LIFETIME allocations on average
+ * allocates from short_heap, a heap of its own, so that short lived blocks do not pin the free space between long
+ * lived ones. */
+#define SAMPLED 0x2
+#define SITE_SLOTS 256
+#define SAMPLE_SLOTS 1024
+#define SAMPLE_PERIOD 8
+#define SITE_MIN_SAMPLES 4		/* a site is predicted long lived until this many samples were seen */
+#define SHORT_LIFETIME 1024
+#define SHORT_HEAP_SIZE (1 << 22)
+
+/* Call site of mm_malloc_site, in the slot of "sites" its identifier hashes to. */
+struct site_stats {
+	uintptr_t site;
+	unsigned long lifetime;		/* moving average of the lifetimes of its sampled blocks */
+	unsigned int samples;
+};
+
+/* A sampled block that has not been freed yet. */
+struct lifetime_sample {
+	void *bp;
+	uintptr_t site;
+	unsigned long birth;
+};
+
+/* Blocks of mm_handle_alloc are MOVABLE (a bit in header and footer) and their payload starts with HANDLE_HDR
+ * bytes holding the address of their handle, so that mm_compact can update the handle of a block it moves.
+ * Handles never move.  They are kept in memlib regions of HANDLE_CHUNK handles each, made as they are needed; the
+ * first slot of a region holds the address of the region made before it. */
+#define MOVABLE 0x4
+#define HANDLE_HDR DSIZE
+
+/* A block given to mm_free_mark carries FREED in its header, not in its footer, until it is really freed.  With a
+ * DSIZE of 16 all four bits below it are flags: the allocated bit, SAMPLED, MOVABLE and FREED.  A DSIZE of 8, on
+ * 32-bit builds, has room for the first three only, so there FREED is the bit below the tag, which halves the
+ * largest block to 128 MB. */
+#if UINTPTR_MAX > 0xffffffffu
+#define FREED 0x8
+#else
+#define FREED ((uintptr_t)1 << (TAG_SHIFT - 1))
+#endif
+_Static_assert(((0x1 | SAMPLED | MOVABLE) & ~(DSIZE - 1)) == 0, "the low flags must be below DSIZE");
+#define HANDLE_CHUNK 4096
+
+/* Handle of a movable block. */
+struct mm_handle {
+	void *block;			/* the block, or the next free handle */
+	unsigned int pins;		/* the block is not moved while this is not zero */
+};
+
+/* Placement of mm_malloc_flags blocks: MM_ISOLATE blocks take whole cache lines, MM_COLOR blocks of COLOR_MIN_SIZE
+ * bytes or more start at successive line offsets within a COLOR_SPAN (a page, as large as the sets of an L1 way). */
+#define CACHE_LINE 64
+#define COLOR_SPAN 4096
+#define COLOR_MIN_SIZE 4096
+
+/* Accounting of a tag of mm_malloc_tagged. */
+struct tag_stats {
+	size_t live;			/* bytes of its allocated blocks */
+	size_t soft_limit;		/* 0 for no limit */
+	size_t hard_limit;		/* 0 for no limit */
+};
+
+/* Heap profile.  Once every prof_interval bytes allocated from the default heap on average (the gap to the next
+ * sample is drawn uniformly from 1 to twice the interval), the block allocated is sampled: it is marked SAMPLED,
+ * like a lifetime sample, and its size and call stack of up to PROF_DEPTH frames are kept in "prof", an open
+ * addressing table of PROF_SLOTS entries keyed by the block, until it is freed.  A block of "size" bytes is
+ * sampled with a probability of about size / prof_interval, so a sample stands for MAX(size, prof_interval)
+ * bytes, its weight.  The table is kept at most PROF_MAX_LIVE full, further samples are dropped.  The stack is
+ * walked by its frame pointers, which the Makefile keeps with -fno-omit-frame-pointer; a frame pointer which does
+ * not go up the stack by at most PROF_MAX_FRAME bytes, as in code built without them, ends the walk. */
+#define PROF_DEPTH 24
+#define PROF_SLOT_BITS 11
+#define PROF_SLOTS (1 << PROF_SLOT_BITS)
+#define PROF_MAX_LIVE (PROF_SLOTS / 4 * 3)
+#define PROF_MAX_FRAME (64 << 10)
+
+/* A sampled block of the heap profile. */
+struct prof_sample {
+	void *bp;			/* NULL for an empty slot */
+	size_t weight;			/* bytes the sample stands for */
+	unsigned int depth;
+	uintptr_t pcs[PROF_DEPTH];	/* return addresses, innermost first, from the allocation function out */
+};
+
+/* Event trace.  With MM_TRACE mm_malloc, the fit search, the placement, coalesce and extend_heap each write a record
+ * of their call, with its length in clock cycles, into a ring of TRACE_RECORDS records of the calling thread, which
+ * keeps the most recent ones.  After a latency spike mm_trace_dump shows whether it came from a long free list walk,
+ * a coalesce or a heap extension.  A ring has a single writer, its thread; it is made on the first event of the
+ * thread in a memlib region and chained from "trace_rings" for the dump, and is kept after the thread exits.
+ * Where <sys/sdt.h> is installed every trace point is also a USDT probe "mm:<op>" with the class, size, detail
+ * and cycles of the record as arguments.  0 compiles the trace points out. */
+#ifndef MM_TRACE
+#define MM_TRACE 0
+#endif
+#define TRACE_RECORDS 4096		/* a power of two */
+
+enum trace_op { TRACE_OP_malloc, TRACE_OP_find_fit, TRACE_OP_place, TRACE_OP_coalesce, TRACE_OP_extend };
+
+/* One traced call, 24 bytes. */
+struct trace_record {
+	uint64_t start;			/* clock when the call started */
+	uint32_t cycles;		/* length of the call */
+	uint32_t size;			/* block size asked for or made */
+	uint32_t detail;		/* blocks looked at by a fit search, remainder of a placement, case of a coalesce */
+	uint8_t op;			/* enum trace_op */
+	int8_t class;			/* segregated class, -1 for none */
+};
+
+/* Trace of one thread. */
+struct trace_ring {
+	struct trace_ring *next;	/* ring made before this one */
+	long thread;
+	uint64_t head;			/* records written so far, the last TRACE_RECORDS of them are kept */
+	struct trace_record records[TRACE_RECORDS];
+};
+
+#if MM_TRACE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_CLOCK() __rdtsc()
+#else
+#include <time.h>
+#define TRACE_CLOCK() trace_clock()
+#endif
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_PROBE(name, class, size, detail, cycles) STAP_PROBE4(mm, name, class, size, detail, cycles)
+#endif
+#endif
+#ifndef TRACE_PROBE
+#define TRACE_PROBE(name, class, size, detail, cycles) ((void)(cycles))
+#endif
+/* TRACE_START(t) starts the clock "t" of a call, TRACE(op, ...) records the call when it ends */
+#define TRACE_START(t) uint64_t t = TRACE_CLOCK()
+#define TRACE(name, class, size, detail, start) \
+	TRACE_PROBE(name, (class), (size), (detail), trace_event(TRACE_OP_##name, (class), (size), (detail), (start)))
+#else
+#define TRACE_START(t) ((void)0)
+#define TRACE(name, class, size, detail, start) ((void)sizeof((class) + (size) + (detail)))
+#endif
+
+/* Incremental checker, see mm_check_slice.  A pass first walks the free lists (or the index), class by class, and
+ * then the blocks of the heap by address, a bounded number of blocks per call, and each block is checked against
+ * its neighbours only, so a pass takes O(n).  The list walk marks the free blocks it reaches with CHECK_MARK in
+ * their header and footer, and while the checker runs add_block_in_segregated_list marks the blocks it adds, so a
+ * free block the heap walk finds unmarked is in no list.  A block is marked when its bit equals check_mark, which
+ * is flipped at the end of each pass, so the marks are never cleared.  Free blocks are never SAMPLED, the bit is
+ * reused. */
+#define CHECK_MARK SAMPLED
+#define CHECK_LISTS 0			/* phases of a pass */
+#define CHECK_HEAP 1
+
+/* How far mm_malloc_near looks on each side of its hint. */
+#define NEAR_BLOCKS 64
+#define NEAR_DISTANCE (2 * 4096)
+
 /* Global variables: */
-static char *heap_listp; /* Pointer to first block */  
-static unsigned int** segregation_classes;	/*used to keep reference of the segregation classes */
+static struct mm_heap default_heap;
+static struct mm_heap *heap = &default_heap;	/* heap that the routines below work on */
+static struct mm_cache *caches;			/* all the object caches, they are reaped when the heap is full */
+static struct site_stats sites[SITE_SLOTS];
+static struct lifetime_sample samples[SAMPLE_SLOTS];
+static unsigned long site_clock;		/* allocations through mm_malloc_site */
+static struct mm_heap *short_heap;		/* heap of the blocks predicted short lived, made on first use */
+static mem_region_t *handle_region;		/* newest region of handles, NULL before the first handle */
+static struct mm_handle *free_handles;		/* handles given back by mm_handle_free */
+static char *compact_cursor;			/* next block mm_compact looks at, NULL to start at the bottom */
+static struct tag_stats tags[NO_TAGS];
+static mm_tag_limit_fn tag_limit_callback;
+static bool tags_used;				/* a block has been tagged, mm_free_batch looks for tags */
+static struct prof_sample prof[PROF_SLOTS];
+static size_t prof_interval;			/* 0 when the profile is off */
+static long prof_countdown = LONG_MAX;		/* bytes still to be allocated before the next sample */
+#if MM_TRACE
+static struct trace_ring *trace_rings;		/* the rings of all threads */
+static __thread struct trace_ring *trace_ring __attribute__((tls_model("initial-exec")));
+static const char *const trace_op_names[] = { "malloc", "find_fit", "place", "coalesce", "extend" };
+#endif
+static bool check_running;			/* mm_check_slice has been called since mm_init */
+static uintptr_t check_mark;			/* the value of CHECK_MARK in marked blocks, this pass */
+static int check_phase;
+static int check_class;				/* class the list walk is in */
+static void *check_entry;			/* next entry of the list walk, NULL at the end of the class */
+static size_t check_steps;			/* entries walked in the class */
+static char *check_cursor;			/* next block of the heap walk, NULL to start at the bottom */
+static size_t prof_live;			/* entries in use in "prof" */
+static uint64_t prof_random = 88172645463325252ull;	/* xorshift state drawing the gaps */
 
 /* Function prototypes for internal helper routines: */
 static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
+static void *heap_sbrk(intptr_t incr);
+static void *heap_lo(void);
+static void *heap_hi(void);
+static int heap_trim(size_t decr);
+static int init_heap(void);
+static size_t trim_heap_top(size_t keep);
 
 /*functions defined exclusively for segregated list implementation*/
 static void add_block_in_segregated_list(void* bp , int class);
 static void remove_from_list(void* bp, int class);
-static void place_segregated_list(void* bp ,size_t asize);
+static void* place_segregated_list(void* bp ,size_t asize);
+static void* place_at_start(void* bp ,size_t asize);
+static void* place_at_end(void* bp ,size_t asize);
 static int get_class_from_size(size_t asize);
 static int get_class(void* bp);
+#if ADAPTIVE_CLASSES
+static void count_request(size_t asize, size_t n);
+static void adapt_classes(void);
+#endif
 static size_t extra_realloc_size(size_t size);
+static size_t adjust_size(size_t size);
+static void* find_fit(size_t asize);
+static void* take_free_block(size_t asize);
+static int compare_block_addresses(const void* a, const void* b);
+static void split_block_tail(void* bp, size_t asize);
+static void* memalign_offset(size_t alignment, size_t offset, size_t size);
+static void slab_unlink(struct cache_slab **list, struct cache_slab *slab);
+static void slab_push(struct cache_slab **list, struct cache_slab *slab);
+static void slab_destroy(struct mm_cache *c, struct cache_slab *slab);
+static int in_short_heap(void *bp);
+static void sample_block(void *bp, uintptr_t site);
+static void sample_freed(void *bp);
+static void observe_lifetime(uintptr_t site, unsigned long lifetime);
+static void sample_moved(void *from, void *to);
+static inline void prof_allocated(void *bp, size_t size);
+static void prof_sample(void *bp, size_t size);
+static struct prof_sample *prof_find(void *bp);
+static void prof_forget(struct prof_sample *smp);
+static long prof_gap(void);
+static inline size_t prof_home(const void *bp);
+static size_t prof_frame_name(uintptr_t pc, char *buf, size_t len);
+static void tag_block(void *bp, unsigned int tag);
+static struct mm_handle *handle_new(void);
+static void tag_charge(unsigned int tag, size_t bytes);
+static bool tag_admits(unsigned int tag, size_t bytes);
+#if MM_TRACE
+static uint32_t trace_event(int op, int class, size_t size, size_t detail, uint64_t start);
+static struct trace_ring *trace_ring_create(void);
+#if !defined(__x86_64__) && !defined(__i386__)
+static uint64_t trace_clock(void);
+#endif
+#endif
 static void* find_fit_by_class_pseudo_best_fit(size_t asize , int class);
+static void* free_list_first(int class);
+static void* free_list_next(void* bp, int class);
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+static int skip_height(int most);
+static struct skip_tower *skip_tower_new(void);
+static void skip_unlink(void *bp, int class);
+static void skip_release(struct mm_heap *h);
+#if ADAPTIVE_CLASSES
+static void skip_clear(int class);
+#endif
+#endif
+#if FREE_INDEX
+static size_t index_capacity(int class, size_t max_size);
+static size_t index_region_size(size_t max_size);
+static int index_init(void);
+static size_t best_fit_scalar(const size_t *sizes, size_t n, size_t asize);
+static size_t best_fit_dispatch(const size_t *sizes, size_t n, size_t asize);
+#if INDEX_SIMD
+static size_t best_fit_avx2(const size_t *sizes, size_t n, size_t asize);
+static size_t best_fit_avx512(const size_t *sizes, size_t n, size_t asize);
+#endif
+
+/* Search used by the index, best_fit_dispatch replaces itself by the best kernel on the first call */
+static size_t (*best_fit_kernel)(const size_t *sizes, size_t n, size_t asize) = best_fit_dispatch;
+#endif
 
 /* Function prototypes for heap consistency checker routines: The functions have been commented but they work correctly*/
 static void checkblock(void *bp);
@@ -121,6 +622,15 @@ static void check_pointers_in_heap(bool verbose);
 static void check_freelist_completeness(bool verbose);
 static void mm_check_coalescing(bool verbose);
 static void mm_check_free(bool verbose);
+static void check_restart(void);
+static int check_list_entry(void *bp);
+static int check_block(void *bp);
+#if !FREE_INDEX
+static int check_links(void *bp);
+#endif
+static bool check_in_heap(void *p);
+static void check_report(const char *what, void *bp);
+static inline void cursors_out_of(char *bp, size_t size);
 
 /* 
  * Requires:
@@ -136,27 +646,95 @@ static void mm_check_free(bool verbose);
 	int
 mm_init(void) 
 {
+	heap = &default_heap;
+	heap->region = NULL;
+	caches = NULL;
+	memset(sites, 0, sizeof(sites));
+	memset(samples, 0, sizeof(samples));
+	site_clock = 0;
+	if (short_heap != NULL)
+		mm_heap_reset(short_heap);
+	while (handle_region != NULL) {
+		mem_region_t *prev = *(mem_region_t **)mem_region_lo(handle_region);
+
+		mem_region_destroy(handle_region);
+		handle_region = prev;
+	}
+	free_handles = NULL;
+	compact_cursor = NULL;
+	check_running = false;
+	check_cursor = NULL;
+	memset(tags, 0, sizeof(tags));
+	tag_limit_callback = NULL;
+	tags_used = false;
+	memset(prof, 0, sizeof(prof));
+	prof_interval = 0;
+	prof_countdown = LONG_MAX;
+	prof_live = 0;
+#if FREE_INDEX
+	/* The index region of the default heap is kept from one mm_init to the next */
+	heap->max_size = mem_maxheapsize();
+	if (heap->index_region == NULL &&
+	    (heap->index_region = mem_region_create(index_region_size(heap->max_size))) == NULL)
+		return (-1);
+#endif
+	return init_heap();
+}
 
-	int n  = NO_SEG_CLASSES; 					//no of segregation classes
+/*
+ * Requires:
+ *   "heap" points to a heap whose memory is empty.
+ *
+ * Effects:
+ *   Lay out the class array, prologue and epilogue of "heap" and give it
+ *   its first free block.  Returns 0 on success and -1 otherwise.
+ */
+static int init_heap(void)
+{
+	int n  = NO_LIST_WORDS; 					//no of segregation classes (and their tails)
+	char *heap_listp;
 
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+	skip_release(heap);						//the towers of the old lists
+#endif
 	/* Create the initial empty heap. */
-	if ((heap_listp = mem_sbrk(4 * WSIZE + n * WSIZE)) == (void *)-1)
+	if ((heap_listp = heap_sbrk(4 * WSIZE + n * WSIZE)) == (void *)-1)
 		return (-1);
 
-	segregation_classes = (unsigned int**) heap_listp;		//setting the array of pointers to free lists
+	heap->segregation_classes = (unsigned int**) heap_listp;	//setting the array of pointers to free lists
 	int i;
 
 	for(i=0;i<n;i++)
-		segregation_classes[i] = NULL;				//inititalise all pointers to be null
+		heap->segregation_classes[i] = NULL;			//inititalise all pointers to be null
+#if MM_STATS
+	memset(&heap->stats, 0, sizeof(heap->stats));
+#endif
+
+#if FREE_INDEX
+	if (index_init() < 0)
+		return (-1);
+#endif
+#if ADAPTIVE_CLASSES
+	{
+		static const size_t initial_limits[NO_SEG_CLASSES - 1] = {
+			MAXSIZE_CLASS_0, MAXSIZE_CLASS_1, MAXSIZE_CLASS_2, MAXSIZE_CLASS_3, MAXSIZE_CLASS_4,
+			MAXSIZE_CLASS_5, MAXSIZE_CLASS_6, MAXSIZE_CLASS_7, MAXSIZE_CLASS_8
+		};
+
+		memcpy(heap->class_limits, initial_limits, sizeof(initial_limits));
+		memset(heap->hist, 0, sizeof(heap->hist));
+		heap->requests = 0;
+	}
+#endif
 
-	heap_listp = (char *)(&segregation_classes[n-1] + 1);		
+	heap_listp = (char *)(&heap->segregation_classes[n-1] + 1);		
 	//now the alignment padding and prologue and epilogue come into picture 
 
 	PUT(heap_listp, 0);                          			/* Alignment padding */
 	PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); 			/* Prologue header */ 
 	PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); 			/* Prologue footer */ 
 	PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     			/* Epilogue header */
-	heap_listp += (2 * WSIZE);
+	heap->heap_listp = heap_listp + (2 * WSIZE);
 
 
 	/* Extend the empty heap with a free block of CHUNKSIZE bytes. */
@@ -172,56 +750,196 @@ mm_init(void)
 
 void remove_from_list(void* bp, int class)			//note bp points to word after header in block
 {
+	STAT(heap->stats.free_bytes[class] -= GET_SIZE(HDRP(bp)));
+	STAT(heap->stats.free_blocks[class]--);
+#if MM_STATS
+	if(heap->stats.free_blocks[class] == 0)
+	{
+		heap->stats.largest[class] = 0;
+		heap->stats.largest_left[class] = false;
+	}
+	else if(GET_SIZE(HDRP(bp)) == heap->stats.largest[class])
+		heap->stats.largest_left[class] = true;
+#endif
+#if FREE_INDEX
+	struct index_class *ic = &heap->index[class];
+	size_t slot = INDEX_SLOT(bp);
+
+	//the last block of the class takes the slot of the removed one
+	ic->count--;
+	if(slot != ic->count)
+	{
+		ic->sizes[slot] = ic->sizes[ic->count];
+		ic->blocks[slot] = ic->blocks[ic->count];
+		SET_INDEX_SLOT(ic->blocks[slot], slot);
+	}
+#else
 
 	unsigned int** prev = (unsigned int**)EXP_GET_PREV_BLKP((unsigned int**)bp);	//get the prev free block in list
 	unsigned int** next = (unsigned int**)EXP_GET_NEXT_BLKP((unsigned int**)bp);	//get the next free block in list
 
+	if(bp == check_entry)
+		check_entry = next;			//the checker's list walk goes on after the block
+
 	//asssumption prev and next point to word after header of prev/next block
 	if(prev != NULL)
 	{
-		*(prev + 1) = (unsigned int*)next;		//change the next field of prev block 
+		EXP_SET_NEXT_BLKP(prev, (uintptr_t)next);	//change the next field of prev block 
 	}
 	else
 	{	
 		//as the block being removed is the header, we need to initialise the header to next block
-		segregation_classes[class] = (unsigned int*)next;	
+		heap->segregation_classes[class] = (unsigned int*)next;	
 	}
 
 	if(next != NULL)
 	{	
-		*(next) = (unsigned int*)prev;			//change the prev field of next block
+		EXP_SET_PREV_BLKP(next, (uintptr_t)prev);	//change the prev field of next block
 	}
 	else
 	{
-		//as the block being removed is the last one in the list, we don't need to do anything	
+		//as the block being removed is the last one in the list, only a FIFO list has to move its tail
+#if LIST_ORDER == LIST_ORDER_FIFO
+		SEG_TAIL(class) = (unsigned int*)prev;
+#endif
 	}
+
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+	//a block with a tower is also unlinked from every level its tower reaches
+	heap->list_length[class]--;
+	if(GET(HDRP(bp)) & SKIP_TOWER)
+		skip_unlink(bp, class);
+#endif
+#endif
 }
 
 /* Requires : 1. block pointer of block to be added from free list 
  *            2. segregated class to which the block pointer is being added
- * Effects : This function is used to add a block to its segregated free list class. The block is added to the beginning of the list because of * LIFO strategy used.
+ * Effects : This function is used to add a block to its segregated free list class. The block is added to the beginning of the list because of * LIFO strategy used (at the end with LIST_ORDER_FIFO, in address order with LIST_ORDER_ADDRESS, at the end of the class arrays with FREE_INDEX).
  */
 
 
 void add_block_in_segregated_list(void* bp , int class)
 {	
+	STAT(heap->stats.free_bytes[class] += GET_SIZE(HDRP(bp)));
+	STAT(heap->stats.free_blocks[class]++);
+#if MM_STATS
+	if(GET_SIZE(HDRP(bp)) > heap->stats.largest[class])
+	{
+		heap->stats.largest[class] = GET_SIZE(HDRP(bp));
+		heap->stats.largest_left[class] = false;
+	}
+#endif
+	if(check_running)
+	{
+		//a block added while the checker runs counts as reached by the list walk
+		PUT(HDRP(bp), (GET(HDRP(bp)) & ~(uintptr_t)CHECK_MARK) | check_mark);
+		PUT(FTRP(bp), (GET(FTRP(bp)) & ~(uintptr_t)CHECK_MARK) | check_mark);
+	}
+#if FREE_INDEX
+	struct index_class *ic = &heap->index[class];
+
+	ic->sizes[ic->count] = GET_SIZE(HDRP(bp));
+	ic->blocks[ic->count] = bp;
+	SET_INDEX_SLOT(bp, ic->count);
+	ic->count++;
+#elif LIST_ORDER == LIST_ORDER_ADDRESS
+	struct skip_tower** heads = SEG_SKIP(class);
+	struct skip_tower** link[SKIP_LEVELS - 1];		//where a tower of bp is linked at each level
+	struct skip_tower* below = NULL;			//last tower below bp
+	struct skip_tower* tower;
+	unsigned int** prev;					//block after which bp goes
+	unsigned int** next;
+	int top = heap->skip_top[class], level, height;
+
+	//go down the towers to the last one below bp
+	for(level = top - 1; level >= 0; level--)
+	{
+		link[level] = (below != NULL) ? &below->next[level] : &heads[level];
+		while(*link[level] != NULL && (*link[level])->block < bp)
+		{
+			below = *link[level];
+			link[level] = &below->next[level];
+		}
+	}
 
+	//and walk the list from its block, or from the head of the list
+	if(below != NULL)
+	{
+		prev = (unsigned int**)below->block;
+		next = (unsigned int**)EXP_GET_NEXT_BLKP(prev);
+	}
+	else
+	{
+		prev = NULL;
+		next = (unsigned int**)heap->segregation_classes[class];
+	}
+	while(next != NULL && (void*)next < bp)
+	{
+		prev = next;
+		next = (unsigned int**)EXP_GET_NEXT_BLKP(next);
+	}
+
+	EXP_SET_PREV_BLKP((unsigned int**)bp, (uintptr_t)prev);
+	EXP_SET_NEXT_BLKP((unsigned int**)bp, (uintptr_t)next);
+	if(prev != NULL)
+		EXP_SET_NEXT_BLKP(prev, (uintptr_t)bp);
+	else
+		heap->segregation_classes[class] = (unsigned int*)bp;
+	if(next != NULL)
+		EXP_SET_PREV_BLKP(next, (uintptr_t)bp);
+
+	//give bp a tower of a random height, or none (also when no tower can be had, the list alone stays correct)
+	height = (++heap->list_length[class] > SKIP_MIN) ? skip_height(top + 1) : 0;
+	if(height > 0 && (tower = skip_tower_new()) != NULL)
+	{
+		tower->block = bp;
+		for(level = 0; level < height; level++)
+		{
+			if(level >= top)
+				link[level] = &heads[level];		//a level the descent did not go through
+			tower->next[level] = *link[level];
+			*link[level] = tower;
+		}
+		if(height > top)
+			heap->skip_top[class] = height;
+		PUT(HDRP(bp), GET(HDRP(bp)) | SKIP_TOWER);
+		PUT(FTRP(bp), GET(FTRP(bp)) | SKIP_TOWER);
+	}
+	else if(GET(HDRP(bp)) & SKIP_TOWER)
+	{
+		PUT(HDRP(bp), GET(HDRP(bp)) & ~(uintptr_t)SKIP_TOWER);
+		PUT(FTRP(bp), GET(FTRP(bp)) & ~(uintptr_t)SKIP_TOWER);
+	}
+#elif LIST_ORDER == LIST_ORDER_FIFO
+	unsigned int** tail = (unsigned int**)SEG_TAIL(class);
+
+	EXP_SET_NEXT_BLKP((unsigned int**)bp, (uintptr_t)NULL);                  //since its the last in the list, its next field is made NULL.
+	EXP_SET_PREV_BLKP((unsigned int**)bp, (uintptr_t)tail);
+
+	if(tail != NULL)
+		EXP_SET_NEXT_BLKP(tail, (uintptr_t)bp);				//next field of the earlier last member is initialised.
+	else
+		heap->segregation_classes[class] = (unsigned int*)bp;		//list was empty, the block is also the first member
+
+	SEG_TAIL(class) = (unsigned int*)bp;
+#else
 	EXP_SET_PREV_BLKP((unsigned int**)bp, (uintptr_t)NULL);                  //since its the first in the list, its prev field is made NULL.
 
-	EXP_SET_NEXT_BLKP((unsigned int**)bp, (uintptr_t)segregation_classes[class]);  // next field is initialised.
+	EXP_SET_NEXT_BLKP((unsigned int**)bp, (uintptr_t)heap->segregation_classes[class]);  // next field is initialised.
 
 	//assumption : segregation classes contain pointer to word after header.
-	if(segregation_classes[class] != NULL)
+	if(heap->segregation_classes[class] != NULL)
 	{
-		*((unsigned int**)segregation_classes[class]) = (unsigned int*)bp;		//prev field of the earlier first member is initialised.
+		EXP_SET_PREV_BLKP(heap->segregation_classes[class], (uintptr_t)bp);		//prev field of the earlier first member is initialised.
 	}
 	else
 	{
 		// do nothing if list was empty inititally.
 	}
 
-	segregation_classes[class] = (unsigned int*)bp;				//new block is made the first member of the list.
-
+	heap->segregation_classes[class] = (unsigned int*)bp;				//new block is made the first member of the list.
+#endif
 }
 
 /* Requires : a block pointer
@@ -241,6 +959,11 @@ static int get_class_from_size(size_t asize)
 {
 	int i;
 
+#if ADAPTIVE_CLASSES
+	for(i = 0; i < NO_SEG_CLASSES - 1 && asize > heap->class_limits[i]; i++)
+		;
+	return i;
+#endif
 	if(asize<= MAXSIZE_CLASS_0)
 		i=0;
 	else if(asize<= MAXSIZE_CLASS_1)
@@ -264,6 +987,98 @@ static int get_class_from_size(size_t asize)
 	return i;
 }
 
+#if ADAPTIVE_CLASSES
+/* Effects : count "n" requests of "asize" bytes, and move the class bounds every ADAPT_PERIOD requests.  A batch
+ * is counted once with its weight, at most ADAPT_PERIOD, which is as much as the counts hold between two moves. */
+static void count_request(size_t asize, size_t n)
+{
+	size_t bucket = MIN(asize / DSIZE, HIST_BUCKETS - 1);
+
+	n = MIN(n, ADAPT_PERIOD);
+	heap->hist[bucket] += n;
+	if((heap->requests += n) >= ADAPT_PERIOD)
+		adapt_classes();
+}
+
+/*
+ * Effects : put the bounds of the classes at the tenths of the sizes counted, requests and free blocks together.
+ *   Counting only requests would put all the small fragments left by splits in the first list, where requests
+ *   would walk past them; with the free blocks counted as well every list is about as long and each class serves
+ *   about as many requests.  The free blocks are found through the lists.  When bounds move, only the classes
+ *   with a moved bound are reshaped: their lists are taken out and each of their blocks is put in the list of its
+ *   new class, which is one of them too.  The counts are then halved.
+ */
+static void adapt_classes(void)
+{
+	size_t limits[NO_SEG_CLASSES - 1];
+	unsigned long total = 0, seen = 0;
+	size_t b = 0, prev = 0;
+	void *moved[NO_SEG_CLASSES];				//lists taken out of reshaped classes
+	int i;
+	void *bp, *next;
+
+	for(i = 0; i < NO_SEG_CLASSES; i++)
+		for(bp = free_list_first(i); bp != NULL; bp = free_list_next(bp, i))
+			heap->hist[MIN(GET_SIZE(HDRP(bp)) / DSIZE, HIST_BUCKETS - 1)]++;
+	for(b = 0; b < HIST_BUCKETS; b++)
+		total += heap->hist[b];
+
+	b = 0;
+	seen = heap->hist[0];
+	for(i = 0; i < NO_SEG_CLASSES - 1; i++)
+	{
+		unsigned long target = total * (i + 1) / NO_SEG_CLASSES;
+
+		while(seen < target && b < HIST_BUCKETS - 1)
+			seen += heap->hist[++b];
+		if(b < HIST_BUCKETS - 1)
+			limits[i] = MAX(b * DSIZE, MAX(prev + DSIZE, 2 * DSIZE));
+		else
+			limits[i] = MAX(2 * prev, HIST_BUCKETS * DSIZE);	//beyond the counts, double the bounds
+		prev = limits[i];
+	}
+
+	for(b = 0; b < HIST_BUCKETS; b++)
+		heap->hist[b] /= 2;
+	heap->requests = 0;
+
+	if(memcmp(limits, heap->class_limits, sizeof(limits)) == 0)
+		return;
+
+	//take out the lists of the classes whose range changes, the others keep all their blocks
+	for(i = 0; i < NO_SEG_CLASSES; i++)
+	{
+		moved[i] = NULL;
+		if((i == 0 || limits[i-1] == heap->class_limits[i-1]) &&
+		   (i == NO_SEG_CLASSES - 1 || limits[i] == heap->class_limits[i]))
+			continue;
+		moved[i] = heap->segregation_classes[i];
+		heap->segregation_classes[i] = NULL;
+#if LIST_ORDER == LIST_ORDER_FIFO
+		SEG_TAIL(i) = NULL;
+#elif LIST_ORDER == LIST_ORDER_ADDRESS
+		skip_clear(i);
+#endif
+#if MM_STATS
+		heap->stats.free_bytes[i] = 0;
+		heap->stats.free_blocks[i] = 0;
+		heap->stats.largest[i] = 0;
+		heap->stats.largest_left[i] = false;
+#endif
+	}
+	memcpy(heap->class_limits, limits, sizeof(limits));
+
+	for(i = 0; i < NO_SEG_CLASSES; i++)
+		for(bp = moved[i]; bp != NULL; bp = next)
+		{
+			next = (void*)EXP_GET_NEXT_BLKP(bp);		//before the block is linked in its new list
+			add_block_in_segregated_list(bp, get_class(bp));
+		}
+	if(check_running && check_phase == CHECK_LISTS)
+		check_restart();				//the list walk would go on in the new lists
+}
+#endif
+
 
 
 /* 
@@ -283,43 +1098,24 @@ void *mm_malloc(size_t size)
 	//checkheap(0);	
 
 	size_t asize;      						/* Adjusted block size */
-	size_t extendsize; 						/* Amount to extend heap if no fit */
 	void *bp;
+	TRACE_START(t);
 
 	/* Ignore spurious requests. */
 	if (size == 0)
 		return (NULL);
 
 	/* Adjust block size to include overhead and alignment reqs. */
-	if (size <= DSIZE)
-		asize = 2 * DSIZE;							//minimum block size is 4 words
-	else
-		asize = DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE);		
-
-
-	/* let us find the segregated class which fits this allocation request */
-
-	int i= get_class_from_size(asize);
-
-	for(; i<=NO_SEG_CLASSES - 1 ; i++)						//loop through larger classes if suitable free block 												//not found
-	{
-		bp = find_fit_by_class_pseudo_best_fit(asize , i);			//find suitable free block in segregated class 'i'
-
-		if(bp!=NULL)			
-		{	//if we find a suitable class.
-			// function for removing 'to be allocated' block from segregated free list. 
-			remove_from_list(bp,i);			
-			place_segregated_list(bp ,asize);			
-			return bp;
-		}		
-	}
+	asize = adjust_size(size);
+#if ADAPTIVE_CLASSES
+	count_request(asize, 1);
+#endif
 
-	/* No fit found.  Get more memory and place the block. */
-	extendsize = MAX(asize, CHUNKSIZE);
-	if ((bp = extend_heap(extendsize / WSIZE)) == NULL)  
+	if ((bp = take_free_block(asize)) == NULL)
 		return (NULL);
-	remove_from_list(bp, get_class(bp));
-	place_segregated_list(bp , asize);
+	bp = place_segregated_list(bp , asize);
+	prof_allocated(bp, size);
+	TRACE(malloc, get_class_from_size(asize), asize, 0, t);
 	return (bp);
 } 
 
@@ -338,8 +1134,17 @@ void mm_free(void *bp)
 	if (bp == NULL)
 		return;
 
+	if (GET(HDRP(bp)) & SAMPLED)
+		sample_freed(bp);
+	if (in_short_heap(bp)) {
+		mm_heap_free(short_heap, bp);
+		return;
+	}
+
 	/* Free and coalesce the block. */
 	size = GET_SIZE(HDRP(bp));
+	if (GET(HDRP(bp)) & TAG_MASK)
+		tags[GET_TAG(HDRP(bp))].live -= size;
 
 	PUT(HDRP(bp), PACK(size, 0));			//make allocated bit 0 in header
 	PUT(FTRP(bp), PACK(size, 0));			//make allocated bit 0 in footer
@@ -350,6 +1155,76 @@ void mm_free(void *bp)
 
 }
 
+/*
+ * Requires:
+ *   "bp" is either the address of an allocated block or NULL, and "size" is
+ *   the payload size it was allocated with.
+ *
+ * Effects:
+ *   Free a block whose size the caller knows, as C++ sized deallocation
+ *   does.  The size is only a lower bound of the block size: a block can be
+ *   bigger than requested when the remainder was too small to split or
+ *   after an in-place mm_realloc.  So the header is compared with the
+ *   header of a plain allocated block of exactly that size, and only when
+ *   they match is the size used directly: no flag, tag or short heap check
+ *   is needed, and a block between two allocated ones goes straight to the
+ *   list of its class without going through coalesce.  Anything else is
+ *   freed by mm_free.
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+	size_t asize;
+	char *next;
+	int class;
+	TRACE_START(t);
+
+	if (bp == NULL || size == 0)
+	{
+		mm_free(bp);
+		return;
+	}
+	asize = adjust_size(size);
+	if (GET(HDRP(bp)) != PACK(asize, 1) || in_short_heap(bp))
+	{
+		mm_free(bp);
+		return;
+	}
+	next = (char *)bp + asize;
+	PUT(HDRP(bp), PACK(asize, 0));
+	PUT(next - DSIZE, PACK(asize, 0));		//footer
+	if (!GET_ALLOC(HDRP(next)) || !GET_ALLOC((char *)bp - DSIZE))
+	{
+		coalesce(bp);
+		return;
+	}
+	class = get_class_from_size(asize);
+	add_block_in_segregated_list(bp, class);
+	TRACE(coalesce, class, asize, 1, t);
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of an allocated block.
+ *
+ * Effects:
+ *   The part of a deferred free which may run without the lock serialising
+ *   the allocator: mark the block as freed by its owner.  Only the owner of
+ *   an allocated block writes its header, and the FREED bit is not one the
+ *   other routines read, so the block stays allocated for them, and for
+ *   the coalescing of its neighbours, until it is freed with mm_free or
+ *   mm_free_batch.  Returns 0, or -1 if the block was already marked, which
+ *   is a second free of it.
+ */
+int mm_free_mark(void *bp)
+{
+	uintptr_t header = __atomic_load_n((uintptr_t *)HDRP(bp), __ATOMIC_RELAXED);
+
+	if (header & FREED)
+		return (-1);
+	__atomic_store_n((uintptr_t *)HDRP(bp), header | FREED, __ATOMIC_RELAXED);	//one store, readers see either word
+	return (0);
+}
+
 /*
  * Requires:
  *   "ptr" is either the address of an allocated block or NULL.
@@ -371,6 +1246,25 @@ void *mm_realloc(void *ptr, size_t size)
 		return (NULL);
 	}
 
+	/* If oldptr is NULL, then this is just malloc. */
+	if (ptr == NULL)
+		return (mm_malloc(size));
+
+	/* A block of the short lived heap is reallocated in that heap, or moved to the default heap when it is full. */
+	if (in_short_heap(ptr)) {
+		struct mm_heap *saved = heap;
+		void *newptr;
+
+		heap = short_heap;
+		newptr = mm_realloc(ptr, size);
+		heap = saved;
+		if (newptr == NULL && (newptr = mm_malloc(size)) != NULL) {
+			memcpy(newptr, ptr, MIN(size, GET_SIZE(HDRP(ptr)) - DSIZE));
+			mm_free(ptr);
+		}
+		return (newptr);
+	}
+
 	//If the realloc'd block has previously been given more size than it needs, then
 	//this realloc request may be serviced within the same block. This will save us time.
 
@@ -386,9 +1280,16 @@ void *mm_realloc(void *ptr, size_t size)
 
 	if(!next_alloc && size < coalesce_size - 2*WSIZE)			//if next block is free and total size of this block and next 											//block is enough to satisfy request
 	{
+		uintptr_t flags = GET(HDRP(ptr)) & FLAG_MASK;	//the block keeps its tag and flag bits
+
+		if((flags & TAG_MASK) && !tag_admits(GET_TAG(HDRP(ptr)), coalesce_size - currSize))
+			return (NULL);				//the block is left as it was
 		remove_from_list(next, get_class(next));
-		PUT(HDRP(ptr) , PACK(coalesce_size , 1));
-		PUT(FTRP(ptr) , PACK(coalesce_size , 1));
+		PUT(HDRP(ptr) , coalesce_size | flags);
+		PUT(FTRP(ptr) , coalesce_size | flags);
+		cursors_out_of(ptr, coalesce_size);	//the compactor and checker must not be left inside the block
+		if(flags & TAG_MASK)
+			tag_charge(GET_TAG(HDRP(ptr)), coalesce_size - currSize);
 		return ptr;
 	}
 
@@ -397,54 +1298,1698 @@ void *mm_realloc(void *ptr, size_t size)
 	size_t newSize = extra_realloc_size(size);	
 	//size_t newSize = size;
 
-	/* If oldptr is NULL, then this is just malloc. */
-	if (ptr == NULL)
-		return (mm_malloc(newSize));
-		
-		
 	void* oldptr = ptr;
 	void* newptr ;
 	size_t copySize ;
+	unsigned int tag = GET_TAG(HDRP(ptr));
 
-	newptr = mm_malloc(newSize);
+	//a tagged block grows by the difference of the two blocks, without the spare room if that is past the hard limit
+	if (tag != 0 && adjust_size(newSize) > currSize && !tag_admits(tag, adjust_size(newSize) - currSize))
+	{
+		newSize = size;
+		if (!tag_admits(tag, adjust_size(newSize) - currSize))
+			return (NULL);
+	}
 
-	/* If realloc() fails the original block is left untouched  */
-	if (newptr == NULL)
-		return (NULL);
+	//the new block is placed at the start of its free block whatever the split direction, so that the rest is
+	//right after it for the next reallocation to grow into
+	if ((newptr = take_free_block(adjust_size(newSize))) == NULL)
+		return (NULL);			/* If realloc() fails the original block is left untouched  */
+	newptr = place_at_start(newptr, adjust_size(newSize));
+	prof_allocated(newptr, size);
 
 	/* Copy the old data. */
 	copySize = GET_SIZE(HDRP(oldptr));
 
-	if (size < copySize)
-		copySize = size;
-	memcpy(newptr, oldptr, copySize);
+	if (size < copySize)
+		copySize = size;
+	memcpy(newptr, oldptr, copySize);
+
+	/* Free the old block, then give its tag to the new one so that the tag is not charged for both. */
+	mm_free(oldptr);
+	if (tag != 0)
+		tag_block(newptr, tag);
+
+	return (newptr);
+}
+
+
+/*
+ * Requires:
+ *   "out" has room for "n" pointers.
+ *
+ * Effects:
+ *   Allocate "n" blocks with at least "size" bytes of payload each and store
+ *   their addresses in "out".  Instead of one class lookup and one list
+ *   removal per block, a free block big enough for as many of the blocks as
+ *   possible is taken off its list once and carved into consecutive blocks
+ *   in a single pass.  Returns the number of blocks allocated, which is less
+ *   than "n" only if the heap ran out of memory.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+	size_t asize, csize, count, i, done = 0;
+	bool grow = true;					//extend the heap for all the remaining blocks at once
+	void *bp;
+
+	if (size == 0)
+		return (0);
+	asize = adjust_size(size);
+#if ADAPTIVE_CLASSES
+	count_request(asize, n);				//before any block is off its list, see adapt_classes
+#endif
+
+	while (done < n)
+	{
+		/* Prefer one free block that can hold all the remaining blocks. */
+		bp = NULL;
+		if (n - done <= SIZE_MAX / asize && (bp = find_fit(asize * (n - done))) == NULL && grow)
+		{
+			if ((bp = extend_heap(MAX(asize * (n - done), CHUNKSIZE) / WSIZE)) != NULL)
+				remove_from_list(bp, get_class(bp));
+			else
+				grow = false;				//only ask for what a single block needs from now on
+		}
+		if (bp == NULL && (bp = take_free_block(asize)) == NULL)	//heap is full, use whatever fits
+			break;
+
+		csize = GET_SIZE(HDRP(bp));
+		count = MIN(n - done, csize / asize);
+
+		/* Carve all but the last block; the last one goes through the usual split. */
+		while (count > 1)
+		{
+			PUT(HDRP(bp), PACK(asize, 1));
+			PUT(FTRP(bp), PACK(asize, 1));
+			out[done++] = bp;
+			STAT(heap->stats.splits++);
+			csize -= asize;
+			bp = NEXT_BLKP(bp);
+			PUT(HDRP(bp), PACK(csize, 0));
+			count--;
+		}
+		PUT(FTRP(bp), PACK(csize, 0));
+		out[done++] = place_segregated_list(bp, asize);
+	}
+	for (i = 0; i < done; i++)				//sampled once the blocks are all carved
+		prof_allocated(out[i], size);
+	return (done);
+}
+
+/*
+ * Requires:
+ *   Every non-NULL entry of "ptrs" is the address of an allocated block.
+ *
+ * Effects:
+ *   Free "n" blocks.  The array is sorted by address in place so that runs of
+ *   blocks lying next to each other in the heap are merged into one free
+ *   block directly, and coalesce() is called once per run instead of once
+ *   per block.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+	size_t i, size;
+	bool ascending = true, descending = true;
+	void *bp;
+
+	/* Arrays built by mm_malloc_batch or torn down in reverse are already ordered, skip the sort for them. */
+	for (i = 1; i < n && (ascending || descending); i++)
+	{
+		if ((uintptr_t)ptrs[i - 1] > (uintptr_t)ptrs[i])
+			ascending = false;
+		else
+			descending = false;
+	}
+	if (descending && !ascending)
+	{
+		for (i = 0; i < n / 2; i++)
+		{
+			bp = ptrs[i];
+			ptrs[i] = ptrs[n - 1 - i];
+			ptrs[n - 1 - i] = bp;
+		}
+	}
+	else if (!ascending)
+		qsort(ptrs, n, sizeof(void *), compare_block_addresses);
+
+	/* Sampled and tagged blocks and blocks of the short lived heap need mm_free. */
+	if (site_clock != 0 || tags_used || prof_live != 0 || short_heap != NULL)
+	{
+		for (i = 0; i < n; i++)
+		{
+			if (ptrs[i] != NULL && ((GET(HDRP(ptrs[i])) & (SAMPLED | TAG_MASK)) || in_short_heap(ptrs[i])))
+			{
+				mm_free(ptrs[i]);
+				ptrs[i] = NULL;
+			}
+		}
+	}
+
+	i = 0;
+
+	while (i < n)
+	{
+		if ((bp = ptrs[i]) == NULL)				//NULL, or already freed above
+		{
+			i++;
+			continue;
+		}
+		size = GET_SIZE(HDRP(bp));
+
+		//extend the run while the next pointer is the block right after it
+		for (i++; i < n && (char *)ptrs[i] == (char *)bp + size; i++)
+			size += GET_SIZE(HDRP(ptrs[i]));
+
+		PUT(HDRP(bp), PACK(size, 0));
+		PUT(FTRP(bp), PACK(size, 0));
+		coalesce(bp);
+	}
+}
+
+/*
+ * Requires:
+ *   "max_size" is the most memory the heap may ever take.
+ *
+ * Effects:
+ *   Create a heap which is independent of the default one: it has its own
+ *   segregation classes and is backed by its own memlib region, whose start
+ *   also holds the heap's descriptor.  Returns NULL on failure.
+ */
+mm_heap_t *mm_heap_create(size_t max_size)
+{
+	mem_region_t *region;
+	struct mm_heap *h;
+
+	if (max_size > SIZE_MAX - HEAP_DESC_SIZE)
+		return (NULL);
+	if ((region = mem_region_create(HEAP_DESC_SIZE + max_size)) == NULL)
+		return (NULL);
+	if ((h = mem_region_sbrk(region, HEAP_DESC_SIZE)) == (void *)-1) {
+		mem_region_destroy(region);		//memlib's own header wrapped the size around
+		return (NULL);
+	}
+	h->region = region;
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+	h->tower_region = NULL;
+#endif
+#if FREE_INDEX
+	h->max_size = max_size;
+	if ((h->index_region = mem_region_create(index_region_size(max_size))) == NULL) {
+		mem_region_destroy(region);
+		return (NULL);
+	}
+#endif
+
+	mm_heap_reset(h);
+	if (h->heap_listp == NULL) {
+		mm_heap_destroy(h);
+		return (NULL);
+	}
+	return (h);
+}
+
+/* Effects: mm_malloc on the heap "h". */
+void *mm_heap_malloc(mm_heap_t *h, size_t size)
+{
+	struct mm_heap *saved = heap;
+	void *bp;
+
+	heap = h;
+	bp = mm_malloc(size);
+	heap = saved;
+	return (bp);
+}
+
+/* Effects: mm_memalign on the heap "h". */
+void *mm_heap_memalign(mm_heap_t *h, size_t alignment, size_t size)
+{
+	struct mm_heap *saved = heap;
+	void *bp;
+
+	heap = h;
+	bp = mm_memalign(alignment, size);
+	heap = saved;
+	return (bp);
+}
+
+/* Effects: mm_free of a block allocated by mm_heap_malloc on "h". */
+void mm_heap_free(mm_heap_t *h, void *ptr)
+{
+	struct mm_heap *saved = heap;
+
+	heap = h;
+	mm_free(ptr);
+	heap = saved;
+}
+
+/*
+ * Requires:
+ *   "h" was returned by mm_heap_create.
+ *
+ * Effects:
+ *   Throw away every block allocated on "h" at once, like mem_reset_brk
+ *   followed by mm_init does for the default heap.  The cost does not depend
+ *   on how many blocks were allocated.
+ */
+void mm_heap_reset(mm_heap_t *h)
+{
+	struct mm_heap *saved = heap;
+
+	/* The descriptor is the first thing in the region, taking it again gives back the same memory. */
+	mem_region_reset_brk(h->region);
+	if (mem_region_sbrk(h->region, HEAP_DESC_SIZE) == (void *)-1) {
+		h->heap_listp = NULL;
+		return;
+	}
+
+	heap = h;
+	if (init_heap() < 0)
+		h->heap_listp = NULL;
+	heap = saved;
+}
+
+/* Effects: release the heap "h" and all the memory of its region. */
+void mm_heap_destroy(mm_heap_t *h)
+{
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+	skip_release(h);
+#endif
+#if FREE_INDEX
+	mem_region_destroy(h->index_region);
+#endif
+	mem_region_destroy(h->region);
+}
+
+/*
+ * Requires:
+ *   "chunk_size" is the number of bytes taken from the heap at a time.
+ *
+ * Effects:
+ *   Create a bump pointer region.  The region takes chunks from the heap
+ *   with mm_malloc (and so from mem_sbrk when the heap has to grow), so it
+ *   can be used alongside the other blocks of the heap.  Returns NULL on
+ *   failure.
+ */
+mm_region_t *mm_region_create(size_t chunk_size)
+{
+	struct mm_region *r;
+
+	if ((r = mm_malloc(sizeof(struct mm_region))) == NULL)
+		return (NULL);
+	r->chunk = NULL;
+	r->top = NULL;
+	r->chunk_size = MAX(chunk_size, CHUNKSIZE);
+	return (r);
+}
+
+/*
+ * Requires:
+ *   "r" was returned by mm_region_create.
+ *
+ * Effects:
+ *   Allocate "size" bytes from the region by bumping its top pointer.  A new
+ *   chunk is taken only when the current one is full.  Blocks of a region
+ *   are not freed one by one, they go away with mm_region_release or
+ *   mm_region_destroy.  Returns NULL if the heap ran out of memory.
+ */
+void *mm_region_malloc(mm_region_t *r, size_t size)
+{
+	struct region_chunk *chunk;
+	char *bp = r->top;
+
+	if (size > SIZE_MAX - REGION_HDR_SIZE - DSIZE)
+		return (NULL);
+	size = DSIZE * ((size + DSIZE - 1) / DSIZE);
+	if (r->chunk != NULL && size <= (size_t)(r->chunk->limit - bp)) {
+		r->top = bp + size;
+		return (bp);
+	}
+
+	/* The current chunk is full, take a new one that fits the request. */
+	size_t csize = MAX(r->chunk_size, size + REGION_HDR_SIZE);
+	if ((chunk = mm_malloc(csize)) == NULL)
+		return (NULL);
+	chunk->prev = r->chunk;
+	chunk->limit = (char *)chunk + csize;
+	r->chunk = chunk;
+
+	bp = (char *)chunk + REGION_HDR_SIZE;
+	r->top = bp + size;
+	return (bp);
+}
+
+/* Effects: remember the current top of the region "r" for mm_region_release. */
+mm_region_mark_t mm_region_mark(mm_region_t *r)
+{
+	mm_region_mark_t mark;
+
+	mark.chunk = r->chunk;
+	mark.top = r->top;
+	return (mark);
+}
+
+/*
+ * Requires:
+ *   "mark" was returned by mm_region_mark on "r" and has not been released
+ *   by an earlier release to an older mark.
+ *
+ * Effects:
+ *   Discard everything allocated in the region after "mark".  The chunks
+ *   taken after the mark go back to the heap.
+ */
+void mm_region_release(mm_region_t *r, mm_region_mark_t mark)
+{
+	struct region_chunk *chunk;
+
+	while (r->chunk != mark.chunk) {
+		chunk = r->chunk;
+		r->chunk = chunk->prev;
+		mm_free(chunk);
+	}
+	r->top = mark.top;
+}
+
+/* Effects: give all the chunks of the region "r" and "r" itself back to the heap. */
+void mm_region_destroy(mm_region_t *r)
+{
+	mm_region_mark_t empty = { NULL, NULL };
+
+	mm_region_release(r, empty);
+	mm_free(r);
+}
+
+/*
+ * Requires:
+ *   "alignment" is a power of two.
+ *
+ * Effects:
+ *   Allocate a block with at least "size" bytes of payload whose address is
+ *   a multiple of "alignment".  Returns NULL on failure.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+	return (memalign_offset(alignment, 0, size));
+}
+
+/*
+ * Requires:
+ *   "flags" is 0 or a combination of MM_ISOLATE and MM_COLOR.
+ *
+ * Effects:
+ *   mm_malloc with placement flags.  An MM_ISOLATE block starts on a cache
+ *   line and its size is rounded up to whole lines, so that no other block's
+ *   payload shares a line with it (only its header and footer do, and they
+ *   are not written while it is allocated).  An MM_COLOR block of at least
+ *   COLOR_MIN_SIZE bytes starts at the next of the COLOR_SPAN / CACHE_LINE
+ *   line offsets within a page, in turn, so that equally sized buffers do
+ *   not all start in the same cache set.
+ */
+void *mm_malloc_flags(size_t size, int flags)
+{
+	static unsigned int next_color;
+	size_t alignment = 0, offset = 0;
+
+	if (flags & MM_ISOLATE) {
+		if (size > SIZE_MAX - CACHE_LINE)
+			return (NULL);
+		size = (size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+		alignment = CACHE_LINE;
+	}
+	if ((flags & MM_COLOR) && size >= COLOR_MIN_SIZE) {
+		offset = next_color * CACHE_LINE;
+		next_color = (next_color + 1) % (COLOR_SPAN / CACHE_LINE);
+		alignment = COLOR_SPAN;
+	}
+	if (alignment == 0)
+		return (mm_malloc(size));
+	return (memalign_offset(alignment, offset, size));
+}
+
+/*
+ * Requires:
+ *   "size" and "align" are the size and alignment of the objects, "align"
+ *   being zero or a power of two.  "ctor" and "dtor" may be NULL.
+ *
+ * Effects:
+ *   Create a cache of constructed objects.  The cache takes slabs from the
+ *   heap and runs "ctor" on every object of a slab when the slab is made.
+ *   Freed objects stay constructed in their slab, "dtor" only runs when a
+ *   slab is given back to the heap by mm_cache_reap or mm_cache_destroy.
+ *   Returns NULL on failure.
+ */
+mm_cache_t *mm_cache_create(size_t size, size_t align, void (*ctor)(void *), void (*dtor)(void *))
+{
+	struct mm_cache *c;
+	size_t hdr;
+
+	if (size == 0 || (align & (align - 1)) != 0)
+		return (NULL);
+	if (size > SIZE_MAX / (8 * CACHE_MIN_OBJS) || align > SIZE_MAX / (8 * CACHE_MIN_OBJS))
+		return (NULL);	//the slab size would overflow
+	if ((c = mm_malloc(sizeof(struct mm_cache))) == NULL)
+		return (NULL);
+
+	align = MAX(align, WSIZE);
+	c->size = (size + align - 1) & ~(align - 1);
+	c->ctor = ctor;
+	c->dtor = dtor;
+	c->partial = NULL;
+	c->full = NULL;
+
+	/* Smallest power of two slab, at least a page, with room for CACHE_MIN_OBJS objects. */
+	c->slab_size = CHUNKSIZE;
+	for (;;) {
+		c->objs_per_slab = (c->slab_size - sizeof(struct cache_slab)) / (c->size + sizeof(unsigned int));
+		hdr = sizeof(struct cache_slab) + c->objs_per_slab * sizeof(unsigned int);
+		c->objs_offset = (hdr + align - 1) & ~(align - 1);
+		if (c->objs_offset + (size_t)c->objs_per_slab * c->size > c->slab_size)
+			c->objs_per_slab--;	//alignment of the first object pushed the last one out
+		if (c->objs_per_slab >= CACHE_MIN_OBJS)
+			break;
+		c->slab_size *= 2;
+	}
+
+	c->next = caches;
+	caches = c;
+	return (c);
+}
+
+/*
+ * Requires:
+ *   "c" was returned by mm_cache_create.
+ *
+ * Effects:
+ *   Return a constructed object of the cache "c", taking a new slab from the
+ *   heap if every slab is full.  Returns NULL if the heap ran out of memory.
+ */
+void *mm_cache_alloc(mm_cache_t *c)
+{
+	struct cache_slab *slab = c->partial;
+	unsigned int i;
+
+	if (slab == NULL) {
+		if ((slab = mm_memalign(c->slab_size, c->slab_size)) == NULL)
+			return (NULL);
+		slab->nfree = c->objs_per_slab;
+		for (i = 0; i < c->objs_per_slab; i++) {
+			slab->free[i] = c->objs_per_slab - 1 - i;	//hand out the objects in address order
+			if (c->ctor != NULL)
+				c->ctor((char *)slab + c->objs_offset + i * c->size);
+		}
+		slab_push(&c->partial, slab);
+	}
+
+	i = slab->free[--slab->nfree];
+	if (slab->nfree == 0) {
+		slab_unlink(&c->partial, slab);
+		slab_push(&c->full, slab);
+	}
+	return ((char *)slab + c->objs_offset + i * c->size);
+}
+
+/*
+ * Requires:
+ *   "obj" was returned by mm_cache_alloc on "c" and is still constructed.
+ *
+ * Effects:
+ *   Put the object back in its slab without destroying it.
+ */
+void mm_cache_free(mm_cache_t *c, void *obj)
+{
+	struct cache_slab *slab = (struct cache_slab *)((uintptr_t)obj & ~(uintptr_t)(c->slab_size - 1));
+
+	if (slab->nfree == 0) {
+		slab_unlink(&c->full, slab);
+		slab_push(&c->partial, slab);
+	}
+	slab->free[slab->nfree++] = ((char *)obj - (char *)slab - c->objs_offset) / c->size;
+}
+
+/*
+ * Effects:
+ *   Destroy the objects of every slab with no object in use, in all the
+ *   caches, and give those slabs back to the heap.  mm_malloc calls this
+ *   when the heap can't grow any more.  Returns the number of bytes given
+ *   back.
+ */
+size_t mm_cache_reap(void)
+{
+	struct mm_cache *c;
+	struct cache_slab *slab, *next;
+	size_t released = 0;
+
+	for (c = caches; c != NULL; c = c->next) {
+		for (slab = c->partial; slab != NULL; slab = next) {
+			next = slab->next;
+			if (slab->nfree == c->objs_per_slab) {
+				slab_unlink(&c->partial, slab);
+				slab_destroy(c, slab);
+				released += c->slab_size;
+			}
+		}
+	}
+	return (released);
+}
+
+/*
+ * Requires:
+ *   No object of "c" is in use.
+ *
+ * Effects:
+ *   Destroy every object of the cache "c" and give its slabs and "c" itself
+ *   back to the heap.
+ */
+void mm_cache_destroy(mm_cache_t *c)
+{
+	struct mm_cache **p;
+
+	while (c->partial != NULL) {
+		struct cache_slab *slab = c->partial;
+		slab_unlink(&c->partial, slab);
+		slab_destroy(c, slab);
+	}
+	for (p = &caches; *p != c; p = &(*p)->next)
+		;
+	*p = c->next;
+	mm_free(c);
+}
+
+/*
+ * Requires:
+ *   "hint" is the address of an allocated block or NULL.
+ *
+ * Effects:
+ *   mm_malloc for a block that will be used together with "hint", e.g. the
+ *   next node of a list.  The blocks around "hint" are visited through
+ *   their boundary tags, up to NEAR_BLOCKS blocks and NEAR_DISTANCE bytes
+ *   on each side, and the closest free block that is big enough is taken;
+ *   the new block is carved from the end of it nearest to "hint".  If none
+ *   is found this is mm_malloc.
+ */
+void *mm_malloc_near(void *hint, size_t size)
+{
+	struct mm_heap *saved = heap;
+	size_t asize;
+	char *lo, *hi, *bp, *after = NULL, *before = NULL;
+	int i;
+
+	if (hint == NULL || size == 0)
+		return (mm_malloc(size));
+	if (in_short_heap(hint))
+		heap = short_heap;
+	asize = adjust_size(size);
+	lo = (char *)hint - NEAR_DISTANCE;
+	hi = (char *)hint + NEAR_DISTANCE;
+
+	//forwards until the epilogue, backwards until the prologue
+	for (i = 0, bp = NEXT_BLKP(hint); i < NEAR_BLOCKS && bp < hi && GET_SIZE(HDRP(bp)) > 0; i++, bp = NEXT_BLKP(bp))
+	{
+		if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= asize)
+		{
+			after = bp;
+			break;
+		}
+	}
+	for (i = 0, bp = hint; i < NEAR_BLOCKS && bp != heap->heap_listp && bp > lo; i++)
+	{
+		bp = PREV_BLKP(bp);
+		if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= asize)
+		{
+			before = bp;
+			break;
+		}
+	}
+	if (before == NULL && after == NULL)
+	{
+		bp = mm_malloc(size);
+		heap = saved;
+		return (bp);
+	}
+#if ADAPTIVE_CLASSES
+	count_request(asize, 1);			//before the block leaves its list, as in mm_malloc
+#endif
+	if (before != NULL && (after == NULL || (char *)hint - FTRP(before) < after - (char *)hint))
+	{
+		remove_from_list(before, get_class(before));
+		bp = place_at_end(before, asize);
+	}
+	else
+	{
+		remove_from_list(after, get_class(after));
+		bp = place_at_start(after, asize);
+	}
+	prof_allocated(bp, size);
+	heap = saved;
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Allocate a movable block with at least "size" bytes of payload and
+ *   return its handle, or NULL on failure.  The block is reached through
+ *   mm_handle_pin, and mm_compact may move it while it is not pinned.
+ */
+mm_handle_t mm_handle_alloc(size_t size)
+{
+	struct mm_handle *h;
+	char *bp;
+
+	if ((h = free_handles) != NULL)
+		free_handles = h->block;
+	else if ((h = handle_new()) == NULL)
+		return (NULL);
+
+	//a size within HANDLE_HDR of SIZE_MAX would wrap around to a small block
+	if (size > SIZE_MAX - HANDLE_HDR || (bp = mm_malloc(size + HANDLE_HDR)) == NULL) {
+		h->block = free_handles;
+		free_handles = h;
+		return (NULL);
+	}
+	*(struct mm_handle **)bp = h;
+	PUT(HDRP(bp), GET(HDRP(bp)) | MOVABLE);
+	PUT(FTRP(bp), GET(FTRP(bp)) | MOVABLE);
+	h->block = bp;
+	h->pins = 0;
+	return (h);
+}
+
+/* Effects: free the block of the handle "h" and the handle. */
+void mm_handle_free(mm_handle_t h)
+{
+	if (h == NULL)
+		return;
+	mm_free(h->block);
+	h->block = free_handles;
+	free_handles = h;
+}
+
+/* Effects: pin the block of "h" where it is and return its address, which stays valid until the last unpin. */
+void *mm_handle_pin(mm_handle_t h)
+{
+	h->pins++;
+	return ((char *)h->block + HANDLE_HDR);
+}
+
+/* Effects: undo one mm_handle_pin of "h". */
+void mm_handle_unpin(mm_handle_t h)
+{
+	h->pins--;
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Do at most about "budget" bytes of compaction work and return the
+ *   number of bytes moved.  The compactor goes up the heap from where the
+ *   last call stopped; a free block followed by an unpinned movable block
+ *   swaps places with it, so free space sinks towards the top of the heap
+ *   and coalesces there.  Each block looked at counts DSIZE bytes of work
+ *   and each block moved its size.  At the end of a pass the free block at
+ *   the top of the heap is given back to memlib and the next call starts
+ *   again at the bottom.
+ */
+size_t mm_compact(size_t budget)
+{
+	size_t work = 0, moved = 0, fsize, bsize, flags;
+	char *bp, *next;
+
+	if (compact_cursor == NULL)
+		compact_cursor = NEXT_BLKP(heap->heap_listp);
+	while (work < budget)
+	{
+		bp = compact_cursor;
+		if (GET_SIZE(HDRP(bp)) == 0)			//the epilogue, the pass is over
+		{
+			trim_heap_top(0);
+			compact_cursor = NULL;
+			break;
+		}
+		next = NEXT_BLKP(bp);
+		work += DSIZE;
+		if (GET_ALLOC(HDRP(bp)) || !(GET(HDRP(next)) & MOVABLE) || (*(struct mm_handle **)next)->pins != 0)
+		{
+			compact_cursor = next;
+			continue;
+		}
+
+		/* Slide the movable block down into the free block bp, the free block goes above it. */
+		fsize = GET_SIZE(HDRP(bp));
+		bsize = GET_SIZE(HDRP(next));
+		flags = GET(HDRP(next)) & FLAG_MASK;		//the block keeps its tag and flag bits
+		remove_from_list(bp, get_class(bp));
+		memmove(bp, next, bsize - DSIZE);
+		PUT(HDRP(bp), PACK(bsize, flags));
+		PUT(FTRP(bp), PACK(bsize, flags & ~FREED));	//FREED is only ever in the header
+		(*(struct mm_handle **)bp)->block = bp;
+		if (flags & SAMPLED)
+			sample_moved(next, bp);
+		if (check_cursor == next)
+			check_cursor = bp;
+
+		next = NEXT_BLKP(bp);
+		PUT(HDRP(next), PACK(fsize, 0));
+		PUT(FTRP(next), PACK(fsize, 0));
+		compact_cursor = coalesce(next);
+		moved += bsize;
+		work += bsize;
+	}
+	return (moved);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Give the free block at the top of the default heap back to memlib,
+ *   keeping "pad" bytes of it for later requests, as malloc_trim does.
+ *   Returns the number of bytes given back.
+ */
+size_t mm_trim(size_t pad)
+{
+	return (trim_heap_top(pad == 0 ? 0 : adjust_size(pad)));
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Start the heap profile, sampling an allocation of the default heap
+ *   every "interval" bytes on average, or stop it with 0.  Samples already
+ *   taken stay until their blocks are freed.
+ */
+void mm_prof_set_interval(size_t interval)
+{
+	prof_interval = interval;
+	prof_countdown = (interval != 0) ? prof_gap() : LONG_MAX;
+}
+
+/*
+ * Requires:
+ *   "fd" is open for writing.
+ *
+ * Effects:
+ *   Write the sampled blocks which are still allocated to "fd" as folded
+ *   stacks, one line per sample: the frames from the outermost one to the
+ *   allocation function separated by ';', a space and the bytes the sample
+ *   stands for.  flamegraph.pl and pprof read this format.  Returns 0 on
+ *   success and -1 if a write failed.
+ */
+int mm_prof_dump(int fd)
+{
+	char line[PROF_DEPTH * 96 + 32];
+	size_t i, len;
+	int j;
+
+	for (i = 0; i < PROF_SLOTS; i++)
+	{
+		const struct prof_sample *smp = &prof[i];
+
+		if (smp->bp == NULL)
+			continue;
+		len = 0;
+		for (j = (int)smp->depth - 1; j >= 0; j--)
+		{
+			len += prof_frame_name(smp->pcs[j], line + len, sizeof(line) - len);
+			if (j > 0)
+				line[len++] = ';';
+		}
+		len += snprintf(line + len, sizeof(line) - len, " %lu\n", (unsigned long)smp->weight);
+		if (write(fd, line, len) != (ssize_t)len)
+			return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Requires:
+ *   "fd" is open for writing.
+ *
+ * Effects:
+ *   Write the records kept in the trace ring of every thread to "fd", the
+ *   oldest first, one line per record: the thread, the clock at the start
+ *   of the call, its length in cycles, the operation, the class, the size
+ *   and the detail (blocks looked at by a find_fit, remainder of a place,
+ *   case of a coalesce).  Other threads may go on allocating, a record
+ *   overwritten while it is read is left out.  Returns 0 on success and -1
+ *   if a write failed or the trace is compiled out (MM_TRACE=0).
+ */
+int mm_trace_dump(int fd)
+{
+#if MM_TRACE
+	char buf[8192];
+	size_t len = 0;
+	struct trace_ring *r;
+	struct trace_record rec;
+	uint64_t head, i;
+
+	for (r = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next)
+	{
+		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		for (i = (head > TRACE_RECORDS) ? head - TRACE_RECORDS : 0; i < head; i++)
+		{
+			rec = r->records[i & (TRACE_RECORDS - 1)];
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&r->head, __ATOMIC_RELAXED) >= i + TRACE_RECORDS)
+				continue;			//its thread has started to write over it
+			if (sizeof(buf) - len < 128)
+			{
+				if (write(fd, buf, len) != (ssize_t)len)
+					return (-1);
+				len = 0;
+			}
+			len += snprintf(buf + len, sizeof(buf) - len, "%ld %llu %lu %s %d %lu %lu\n", r->thread,
+			    (unsigned long long)rec.start, (unsigned long)rec.cycles, trace_op_names[rec.op],
+			    rec.class, (unsigned long)rec.size, (unsigned long)rec.detail);
+		}
+	}
+	if (write(fd, buf, len) != (ssize_t)len)
+		return (-1);
+	return (0);
+#else
+	(void)fd;
+	return (-1);
+#endif
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Fill "st" with the state of the default heap.  The heap size comes from
+ *   memlib; everything else is read from counters kept as the heap changes,
+ *   so this takes a few hundred nanoseconds.  The largest free block is the
+ *   running maximum of the highest non-empty class, except when that block
+ *   has left the class since it was last known: then the class is walked
+ *   to find the next one, once.  Returns 0, or -1 when the
+ *   counters are compiled out (MM_STATS=0) and only the heap size is set.
+ */
+int mm_stats(struct mm_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->heap_size = (char *)heap_hi() + 1 - (char *)heap_lo();
+#if MM_STATS
+	struct heap_counters *c = &heap->stats;
+	size_t overhead;
+	void *bp;
+	int i;
+
+	for (i = 0; i < NO_SEG_CLASSES; i++)
+	{
+		st->class_free_bytes[i] = c->free_bytes[i];
+		st->class_free_blocks[i] = c->free_blocks[i];
+		st->free_bytes += c->free_bytes[i];
+		st->free_blocks += c->free_blocks[i];
+	}
+	for (i = NO_SEG_CLASSES - 1; i >= 0 && c->free_blocks[i] == 0; i--)
+		;
+	if (i >= 0 && c->largest_left[i])		//the list is only walked when its largest block has gone
+	{
+		c->largest[i] = 0;
+		for (bp = free_list_first(i); bp != NULL; bp = free_list_next(bp, i))
+			c->largest[i] = MAX(c->largest[i], GET_SIZE(HDRP(bp)));
+		c->largest_left[i] = false;
+	}
+	if (i >= 0)
+		st->largest_free = c->largest[i];
+
+	/* Everything in the heap which is not a free block, the class array, prologue and epilogue is an allocated block */
+	overhead = (char *)HDRP(NEXT_BLKP(heap->heap_listp)) - (char *)heap_lo() + WSIZE;
+	st->live_bytes = st->heap_size - overhead - st->free_bytes;
+	st->splits = c->splits;
+	st->coalesces = c->coalesces;
+	st->extends = c->extends;
+	return (0);
+#else
+	return (-1);
+#endif
+}
+
+/*
+ * Requires:
+ *   "fd" is open for writing.
+ *
+ * Effects:
+ *   Write a snapshot of the default heap to "fd" in the layout of
+ *   mm_snapshot.h: walking the boundary tags as checkheap does, a record of
+ *   the address, size, flags, class and tag of every block, for mmfrag to
+ *   analyse.  Blocks of mm_heap_create heaps are not in it.  Returns 0 on
+ *   success and -1 if a write failed.
+ */
+int mm_dump_heap(int fd)
+{
+	struct mm_snapshot_header hdr;
+	struct mm_snapshot_block buf[256];
+	char *first = NEXT_BLKP(heap->heap_listp);	//the block after the prologue
+	char *bp;
+	size_t n = 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = MM_SNAPSHOT_MAGIC;
+	hdr.version = MM_SNAPSHOT_VERSION;
+	hdr.heap_lo = (uintptr_t)heap_lo();
+	hdr.heap_size = (char *)heap_hi() + 1 - (char *)heap_lo();
+	hdr.page_size = mem_pagesize();
+	hdr.word_size = WSIZE;
+	for (bp = first; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+		hdr.blocks++;
+	if (write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr))
+		return (-1);
+
+	memset(buf, 0, sizeof(buf));
+	for (bp = first; ; bp = NEXT_BLKP(bp))
+	{
+		if (n == sizeof(buf) / sizeof(buf[0]) || (GET_SIZE(HDRP(bp)) == 0 && n > 0))
+		{
+			if (write(fd, buf, n * sizeof(buf[0])) != (ssize_t)(n * sizeof(buf[0])))
+				return (-1);
+			n = 0;
+		}
+		if (GET_SIZE(HDRP(bp)) == 0)			//the epilogue
+			break;
+		buf[n].addr = (uintptr_t)bp;
+		buf[n].size = GET_SIZE(HDRP(bp));
+		buf[n].flags = !GET_ALLOC(HDRP(bp)) ? 0 :	//the checker marks free blocks
+		    (GET(HDRP(bp)) & (0x1 | SAMPLED | MOVABLE)) | ((GET(HDRP(bp)) & FREED) ? MM_SNAPSHOT_FREED : 0);
+		buf[n].class = get_class(bp);
+		buf[n].tag = GET_TAG(HDRP(bp));
+		n++;
+	}
+	return (0);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   mm_malloc for a block owned by "tag", which must be below MM_TAGS (below
+ *   16 on 32-bit builds).  The tag is kept in the header and footer of the
+ *   block and the block size is counted in the live bytes of the tag until
+ *   the block is freed; mm_realloc keeps the tag.  If the block would take
+ *   the tag past its hard limit the limit callback is called, which may free
+ *   blocks of the tag, and the allocation fails if the tag would still be
+ *   past it.  Going past the soft limit calls the callback once the block is
+ *   allocated.  Tag 0 is plain mm_malloc.
+ */
+void *mm_malloc_tagged(size_t size, unsigned int tag)
+{
+	void *bp;
+
+	if (tag == 0)
+		return (mm_malloc(size));
+	if (tag >= NO_TAGS || size == 0)
+		return (NULL);
+	if (!tag_admits(tag, adjust_size(size)))
+		return (NULL);
+	if ((bp = mm_malloc(size)) == NULL)
+		return (NULL);
+	tag_block(bp, tag);
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Returns the bytes of the allocated blocks of "tag", headers and footers
+ *   included.
+ */
+size_t mm_tag_live(unsigned int tag)
+{
+	if (tag == 0 || tag >= NO_TAGS)
+		return (0);
+	return (tags[tag].live);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Set the soft and hard limits of "tag" on its live bytes, 0 for no limit.
+ */
+void mm_tag_set_limits(unsigned int tag, size_t soft, size_t hard)
+{
+	if (tag == 0 || tag >= NO_TAGS)
+		return;
+	tags[tag].soft_limit = soft;
+	tags[tag].hard_limit = hard;
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Set the function called when a tag goes past one of its limits, NULL
+ *   for none.  It may allocate and free.
+ */
+void mm_tag_set_callback(mm_tag_limit_fn fn)
+{
+	tag_limit_callback = fn;
+}
+
+/*
+ * Requires:
+ *   "lifetime" is MM_LIFETIME_SHORT or MM_LIFETIME_LONG.
+ *
+ * Effects:
+ *   mm_malloc for a block the caller expects to be freed soon (short) or to
+ *   stay (long).  Short lived blocks are allocated in a heap of their own,
+ *   made on first use, and so never sit between long lived blocks; once
+ *   that heap is full they go to the default heap.  They are freed with
+ *   mm_free.
+ */
+void *mm_malloc_lifetime(size_t size, int lifetime)
+{
+	void *bp;
+
+	if (lifetime == MM_LIFETIME_SHORT && heap == &default_heap)
+	{
+		if (short_heap == NULL)
+			short_heap = mm_heap_create(SHORT_HEAP_SIZE);
+		if (short_heap != NULL && (bp = mm_heap_malloc(short_heap, size)) != NULL)
+			return (bp);
+	}
+	return (mm_malloc(size));
+}
+
+/*
+ * Requires:
+ *   "site" identifies the place in the program the block is allocated
+ *   from, e.g. a return address or a constant chosen by the caller.
+ *
+ * Effects:
+ *   mm_malloc_lifetime with the lifetime predicted for "site" from the
+ *   sampled lifetimes of its earlier blocks.  A site is taken to be long
+ *   lived until enough of its blocks were seen.
+ */
+void *mm_malloc_site(size_t size, uintptr_t site)
+{
+	struct site_stats *s = &sites[(site ^ (site >> 12)) % SITE_SLOTS];
+	int lifetime = MM_LIFETIME_LONG;
+	void *bp;
+
+	if (s->site != site)
+	{
+		s->site = site;			//a new site takes over the slot
+		s->lifetime = 0;
+		s->samples = 0;
+	}
+	if (s->samples >= SITE_MIN_SAMPLES && s->lifetime < SHORT_LIFETIME)
+		lifetime = MM_LIFETIME_SHORT;
+
+	bp = mm_malloc_lifetime(size, lifetime);
+	if (bp != NULL && ++site_clock % SAMPLE_PERIOD == 0)
+		sample_block(bp, site);
+	return (bp);
+}
+
+/* Effects: mm_malloc_site with the return address of the call as the site. */
+void *mm_malloc_caller(size_t size)
+{
+	return (mm_malloc_site(size, (uintptr_t)__builtin_return_address(0)));
+}
+
+/*
+ * Requires:
+ *   "ptr" is the address of an allocated block.
+ *
+ * Effects:
+ *   Returns the number of payload bytes of the block, which may be more
+ *   than were asked for.
+ */
+size_t mm_usable_size(void *ptr)
+{
+	return (GET_SIZE(HDRP(ptr)) - DSIZE);
+}
+
+static size_t extra_realloc_size(size_t size)
+{
+	size_t biggerBuffer = size * 16; 
+
+	//But we will clamp that extra amount in multiples of page size
+	if (biggerBuffer > size + 24576) { //currently at 6 pages
+		biggerBuffer = size + 24576;
+	}
+
+	return biggerBuffer;
+
+}
+
+
+
+
+/*
+ * The following routines are internal helper routines.
+ */
+
+/*
+ * Requires:
+ *   "size" is not zero.
+ *
+ * Effects:
+ *   Adjust a requested payload size to a block size that includes the
+ *   header/footer overhead and meets the alignment and minimum size.
+ */
+static size_t adjust_size(size_t size)
+{
+	if (size <= DSIZE)
+		return (2 * DSIZE);						//minimum block size is 4 words
+	if (size > MAX_BLOCK_SIZE - 2 * DSIZE)
+		return (MAX_BLOCK_SIZE);			//a size no heap can hold, rather than wrap to a small one
+	return (DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE));
+}
+
+/*
+ * Requires:
+ *   "asize" is an adjusted block size.
+ *
+ * Effects:
+ *   Search the class of "asize" and then every larger class for a free
+ *   block of at least "asize" bytes.  The block found is removed from its
+ *   free list.  Returns NULL if no class has a suitable block.
+ */
+static void* find_fit(size_t asize)
+{
+	void *bp;
+	int i = get_class_from_size(asize);
+
+	for(; i<=NO_SEG_CLASSES - 1 ; i++)				//loop through larger classes if suitable free block not found
+	{
+		bp = find_fit_by_class_pseudo_best_fit(asize , i);	//find suitable free block in segregated class 'i'
+
+		if(bp!=NULL)			
+		{	
+			// remove the 'to be allocated' block from segregated free list. 
+			remove_from_list(bp,i);
+			return bp;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Requires:
+ *   "asize" is an adjusted block size.
+ *
+ * Effects:
+ *   Find a free block of at least "asize" bytes, extending the heap if
+ *   there is none, and remove it from its free list.  Returns NULL if the
+ *   heap is out of memory.
+ */
+static void* take_free_block(size_t asize)
+{
+	size_t extendsize; 						/* Amount to extend heap if no fit */
+	void *bp;
+
+	/* let us find the segregated class which fits this allocation request */
+	if ((bp = find_fit(asize)) != NULL)
+		return (bp);
+
+	/* No fit found.  Get more memory. */
+	extendsize = MAX(asize, CHUNKSIZE);
+	if ((bp = extend_heap(extendsize / WSIZE)) != NULL)  
+		remove_from_list(bp, get_class(bp));
+	else {
+		/* Out of memory: give the empty slabs of the object caches back and look again. */
+		if (heap != &default_heap || mm_cache_reap() == 0)
+			return (NULL);
+		bp = find_fit(asize);
+	}
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "alignment" is a power of two and "offset" a multiple of DSIZE smaller
+ *   than it.
+ *
+ * Effects:
+ *   Allocate a block with at least "size" bytes of payload whose address is
+ *   "offset" bytes past a multiple of "alignment".  A block big enough to
+ *   contain such a block is allocated, then the space in front of that
+ *   address and the space after the payload are split off and freed.
+ *   Returns NULL on failure.
+ */
+static void* memalign_offset(size_t alignment, size_t offset, size_t size)
+{
+	size_t asize, lead, csize;
+	char *bp, *aligned;
+
+	if (alignment <= DSIZE)
+		return (mm_malloc(size));
+	if (size == 0 || alignment > SIZE_MAX / 4 || size > SIZE_MAX / 2 - alignment)
+		return (NULL);							//the sizes below would overflow
+
+	/* Room for the payload and a leading fragment of at least the minimum block size.  Not taken with mm_malloc,
+	 * the block could be sampled before its start is given back. */
+	asize = adjust_size(size);
+	csize = adjust_size(asize + alignment + 2 * DSIZE);
+	if ((bp = take_free_block(csize)) == NULL)
+		return (NULL);
+	bp = place_segregated_list(bp, csize);
+
+	aligned = (char *)((((uintptr_t)bp - offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) + offset);
+	if (aligned != bp) {
+		while ((size_t)(aligned - bp) < 2 * DSIZE)
+			aligned += alignment;
+
+		/* Give the leading fragment back to the free lists. */
+		lead = aligned - bp;
+		csize = GET_SIZE(HDRP(bp));
+		STAT(heap->stats.splits++);
+		PUT(HDRP(bp), PACK(lead, 0));
+		PUT(FTRP(bp), PACK(lead, 0));
+		PUT(HDRP(aligned), PACK(csize - lead, 1));
+		PUT(FTRP(aligned), PACK(csize - lead, 1));
+		coalesce(bp);
+	}
+	split_block_tail(aligned, asize);
+	prof_allocated(aligned, size);
+	return (aligned);
+}
+
+/* Effects : remove a slab from a partial or full list of its cache */
+static void slab_unlink(struct cache_slab **list, struct cache_slab *slab)
+{
+	if (slab->prev != NULL)
+		slab->prev->next = slab->next;
+	else
+		*list = slab->next;
+	if (slab->next != NULL)
+		slab->next->prev = slab->prev;
+}
+
+/* Effects : add a slab at the front of a partial or full list of its cache */
+static void slab_push(struct cache_slab **list, struct cache_slab *slab)
+{
+	slab->prev = NULL;
+	slab->next = *list;
+	if (*list != NULL)
+		(*list)->prev = slab;
+	*list = slab;
+}
+
+/* Effects : run the destructor on every object of an unused slab and free the slab */
+static void slab_destroy(struct mm_cache *c, struct cache_slab *slab)
+{
+	unsigned int i;
+
+	if (c->dtor != NULL)
+		for (i = 0; i < c->objs_per_slab; i++)
+			c->dtor((char *)slab + c->objs_offset + i * c->size);
+	mm_free(slab);
+}
+
+/* Effects : true if "bp" is a block of the short lived heap while the default heap is in use */
+static int in_short_heap(void *bp)
+{
+	return (short_heap != NULL && heap == &default_heap &&
+		(char *)bp > (char *)short_heap && (char *)bp <= (char *)mem_region_hi(short_heap->region));
+}
+
+/* Effects : remember the birth of the block "bp" of "site" and mark it, unless its sample slot holds a block
+ * that is still young (a block that was never freed is only known to be long lived once it is old). */
+static void sample_block(void *bp, uintptr_t site)
+{
+	struct lifetime_sample *smp = &samples[((uintptr_t)bp / DSIZE) % SAMPLE_SLOTS];
+
+	if (smp->bp != NULL && smp->bp != bp)
+	{
+		if (site_clock - smp->birth < SHORT_LIFETIME)
+			return;
+		observe_lifetime(smp->site, site_clock - smp->birth);
+	}
+	smp->bp = bp;
+	smp->site = site;
+	smp->birth = site_clock;
+	PUT(HDRP(bp), GET(HDRP(bp)) | SAMPLED);
+	PUT(FTRP(bp), GET(FTRP(bp)) | SAMPLED);
+}
+
+/* Effects : a sampled block is being freed, count its lifetime for its site and unmark it */
+static void sample_freed(void *bp)
+{
+	struct lifetime_sample *smp = &samples[((uintptr_t)bp / DSIZE) % SAMPLE_SLOTS];
+
+	if (smp->bp == bp)
+	{
+		observe_lifetime(smp->site, site_clock - smp->birth);
+		smp->bp = NULL;
+	}
+	if (prof_live != 0)
+		prof_forget(prof_find(bp));
+	PUT(HDRP(bp), GET(HDRP(bp)) & ~(uintptr_t)SAMPLED);
+	PUT(FTRP(bp), GET(FTRP(bp)) & ~(uintptr_t)SAMPLED);
+}
+
+/* Effects : the sampled block "from" has been moved to "to" by mm_compact.  Its lifetime sample is dropped, the
+ * lifetime tables are indexed by address; its profile sample follows it. */
+static void sample_moved(void *from, void *to)
+{
+	struct lifetime_sample *smp = &samples[((uintptr_t)from / DSIZE) % SAMPLE_SLOTS];
+	struct prof_sample *ps, copy;
+
+	if (smp->bp == from)
+		smp->bp = NULL;
+	if (prof_live != 0 && (ps = prof_find(from)) != NULL)
+	{
+		copy = *ps;
+		prof_forget(ps);
+		copy.bp = to;
+		*prof_find(to) = copy;				//prof_find returns the empty slot for "to"
+		prof_live++;
+	}
+}
+
+/* Effects : count an allocation of "size" bytes made at "bp" towards the next profile sample, and take the
+ * sample if it is due.  With the profile off the countdown starts at LONG_MAX and never runs out, so the test
+ * is the same single subtraction either way. */
+static inline void prof_allocated(void *bp, size_t size)
+{
+	if ((prof_countdown -= (long)size) <= 0)
+		prof_sample(bp, size);
+}
+
+/* Effects : sample the block "bp" of "size" bytes and draw the gap to the next sample.  A frame starts with the
+ * frame pointer of its caller and the return address into it, so the walk costs two loads a frame, where the
+ * unwinder of libgcc looked each frame up in the unwind tables for about 2 us a sample.  The frame pointers are
+ * checked before they are followed: they must go up the stack, by at most PROF_MAX_FRAME bytes, and stay below
+ * the top of the stack of the main thread, so a walk into code built without frame pointers stops there. */
+static __attribute__((noinline)) void prof_sample(void *bp, size_t size)
+{
+	extern void *__libc_stack_end;
+	struct prof_sample *smp;
+	uintptr_t *fp = __builtin_frame_address(0), *next;
+
+	if (heap != &default_heap)		//the others are not freed with mm_free, the next block of the default
+		return;				//heap is sampled instead
+	prof_countdown = prof_gap();
+	if (prof_live >= PROF_MAX_LIVE || (smp = prof_find(bp))->bp != NULL)
+		return;
+	smp->bp = bp;
+	smp->weight = MAX(size, prof_interval);
+	smp->depth = 0;
+	while (smp->depth < PROF_DEPTH && fp[1] != 0)
+	{
+		smp->pcs[smp->depth++] = fp[1];		//pcs[0] is in the allocation function
+		next = (uintptr_t *)fp[0];
+		if (next <= fp || (uintptr_t)next - (uintptr_t)fp > PROF_MAX_FRAME ||
+		    (uintptr_t)next % sizeof(void *) != 0 || (fp < (uintptr_t *)__libc_stack_end &&
+		    next + 2 > (uintptr_t *)__libc_stack_end))
+			break;
+		fp = next;
+	}
+	prof_live++;
+	PUT(HDRP(bp), GET(HDRP(bp)) | SAMPLED);
+	PUT(FTRP(bp), GET(FTRP(bp)) | SAMPLED);
+}
+
+/* Effects : the slot of "bp" in the profile table, or the empty slot where it would go. */
+static struct prof_sample *prof_find(void *bp)
+{
+	size_t i = prof_home(bp);
+
+	while (prof[i].bp != NULL && prof[i].bp != bp)
+		i = (i + 1) & (PROF_SLOTS - 1);
+	return (&prof[i]);
+}
+
+/* Effects : empty the profile slot "smp", if it is in use, and move back the entries after it which would no
+ * longer be found past the hole (deletion without tombstones). */
+static void prof_forget(struct prof_sample *smp)
+{
+	size_t hole = smp - prof, i = hole, home;
+
+	if (smp->bp == NULL)
+		return;
+	smp->bp = NULL;
+	prof_live--;
+	for (;;)
+	{
+		i = (i + 1) & (PROF_SLOTS - 1);
+		if (prof[i].bp == NULL)
+			return;
+		home = prof_home(prof[i].bp);
+		//the entry stays if its home is cyclically in (hole, i]
+		if (hole < i ? (home > hole && home <= i) : (home > hole || home <= i))
+			continue;
+		prof[hole] = prof[i];
+		prof[i].bp = NULL;
+		hole = i;
+	}
+}
+
+/* Effects : write the name of the function containing the return address "pc" into "buf": its symbol if the
+ * dynamic symbol table has it, else its module and offset for addr2line.  Returns the length written. */
+static size_t prof_frame_name(uintptr_t pc, char *buf, size_t len)
+{
+	Dl_info info;
+	const char *module;
+	int n;
+
+	if (dladdr((void *)(pc - 1), &info) == 0 || info.dli_fname == NULL)
+		n = snprintf(buf, len, "0x%lx", (unsigned long)pc);
+	else if (info.dli_sname != NULL)
+		n = snprintf(buf, len, "%.80s", info.dli_sname);
+	else
+	{
+		module = strrchr(info.dli_fname, '/');
+		module = (module != NULL) ? module + 1 : info.dli_fname;
+		n = snprintf(buf, len, "%.40s+0x%lx", module, (unsigned long)(pc - (uintptr_t)info.dli_fbase));
+	}
+	return (n < 0 ? 0 : MIN((size_t)n, len - 1));
+}
+
+/* Effects : the home slot of "bp" in the profile table, the high bits of a Fibonacci hash of its address: blocks
+ * a fixed stride apart spread over the whole table, where the low bits of a product would repeat. */
+static inline size_t prof_home(const void *bp)
+{
+	return ((size_t)(((uint64_t)(uintptr_t)bp * 0x9e3779b97f4a7c15ull) >> (64 - PROF_SLOT_BITS)));
+}
+
+/* Effects : draw the number of bytes to the next profile sample, uniformly from 1 to 2 * prof_interval. */
+static long prof_gap(void)
+{
+	prof_random ^= prof_random << 13;
+	prof_random ^= prof_random >> 7;
+	prof_random ^= prof_random << 17;
+	return (long)(1 + prof_random % (2 * (uint64_t)prof_interval));
+}
+
+#if MM_TRACE
+/*
+ * Requires:
+ *   "start" was taken by TRACE_START at the start of the call.
+ *
+ * Effects:
+ *   Write the record of a call into the ring of the calling thread, making
+ *   the ring on its first event.  The record is dropped if the ring cannot
+ *   be made.  Returns the length of the call in cycles.
+ */
+static uint32_t trace_event(int op, int class, size_t size, size_t detail, uint64_t start)
+{
+	uint32_t cycles = (uint32_t)MIN(TRACE_CLOCK() - start, UINT32_MAX);
+	struct trace_ring *r = trace_ring;
+	struct trace_record *rec;
+
+	if (r == NULL && (r = trace_ring_create()) == NULL)
+		return (cycles);
+	rec = &r->records[r->head & (TRACE_RECORDS - 1)];
+	rec->start = start;
+	rec->cycles = cycles;
+	rec->size = (uint32_t)MIN(size, UINT32_MAX);
+	rec->detail = (uint32_t)MIN(detail, UINT32_MAX);
+	rec->op = (uint8_t)op;
+	rec->class = (int8_t)class;
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);	//the record is complete for mm_trace_dump
+	return (cycles);
+}
+
+/* Effects : make the ring of the calling thread and chain it to the others, NULL if memlib has no room for it */
+static struct trace_ring *trace_ring_create(void)
+{
+	mem_region_t *region = mem_region_create(sizeof(struct trace_ring));
+	struct trace_ring *r;
+
+	if (region == NULL)
+		return (NULL);
+	if ((r = mem_region_sbrk(region, sizeof(struct trace_ring))) == (void *)-1)
+	{
+		mem_region_destroy(region);
+		return (NULL);
+	}
+	r->thread = (long)gettid();
+	r->head = 0;
+	r->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&trace_rings, &r->next, r, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	trace_ring = r;
+	return (r);
+}
+
+#if !defined(__x86_64__) && !defined(__i386__)
+/* Effects : the clock of the trace where there is no cycle counter to read, in nanoseconds */
+static uint64_t trace_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+#endif
+#endif
+
+/* Effects : add a lifetime to the moving average of "site", if the site still has its slot */
+static void observe_lifetime(uintptr_t site, unsigned long lifetime)
+{
+	struct site_stats *s = &sites[(site ^ (site >> 12)) % SITE_SLOTS];
+
+	if (s->site != site)
+		return;
+	lifetime = MIN(lifetime, 64 * SHORT_LIFETIME);
+	s->lifetime = (s->samples == 0) ? lifetime : (3 * s->lifetime + lifetime) / 4;
+	if (s->samples < SITE_MIN_SAMPLES)
+		s->samples++;
+}
+
+/* Effects : qsort() comparator ordering block pointers by address */
+static int compare_block_addresses(const void* a, const void* b)
+{
+	uintptr_t x = (uintptr_t)*(void* const*)a;
+	uintptr_t y = (uintptr_t)*(void* const*)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Effects: grow the current heap by "incr" bytes, mem_sbrk style. */
+static void *heap_sbrk(intptr_t incr)
+{
+	if (heap->region == NULL)
+		return mem_sbrk(incr);
+	return mem_region_sbrk(heap->region, incr);
+}
 
-	/* Free the old block. */
-	mm_free(oldptr);
+/* Effects: address of the first byte of the current heap. */
+static void *heap_lo(void)
+{
+	if (heap->region == NULL)
+		return mem_heap_lo();
+	return mem_region_lo(heap->region);
+}
 
-	return (newptr);
+/* Effects: shrink the current heap by "decr" bytes, mem_trim style. */
+static int heap_trim(size_t decr)
+{
+	if (heap->region == NULL)
+		return mem_trim(decr);
+	return mem_region_trim(heap->region, decr);
 }
 
+/* Effects: give the free block at the top of the current heap, if there is one, back to memlib, all but
+ * its first "keep" bytes (0, or a block size).  Returns the number of bytes given back. */
+static size_t trim_heap_top(size_t keep)
+{
+	char *end = (char *)heap_hi() + 1;		//the epilogue is the header of a block starting here
+	char *last = PREV_BLKP(end);
+	size_t size;
 
-static size_t extra_realloc_size(size_t size)
+	if (last == heap->heap_listp || GET_ALLOC(HDRP(last)))
+		return (0);
+	size = GET_SIZE(HDRP(last));
+	if (keep != 0 && size < keep + 2 * DSIZE)
+		return (0);
+	remove_from_list(last, get_class(last));
+	if (keep != 0)
+	{
+		PUT(HDRP(last), PACK(keep, 0));
+		PUT(FTRP(last), PACK(keep, 0));
+		add_block_in_segregated_list(last, get_class(last));
+		last = NEXT_BLKP(last);
+	}
+	PUT(HDRP(last), PACK(0, 1));			/* New epilogue header */
+	if (check_cursor > last)
+		check_cursor = last;			//the checker's heap walk was at the old epilogue
+	heap_trim(size - keep);
+	return (size - keep);
+}
+
+/* Effects: take a handle that has never been used from the newest region of handles, making a region when it is
+ * full.  Returns NULL if no region can be made. */
+static struct mm_handle *handle_new(void)
 {
-	size_t biggerBuffer = size * 16; 
+	mem_region_t *r;
 
-	//But we will clamp that extra amount in multiples of page size
-	if (biggerBuffer > size + 24576) { //currently at 6 pages
-		biggerBuffer = size + 24576;
+	if (handle_region == NULL || mem_region_size(handle_region) == HANDLE_CHUNK * sizeof(struct mm_handle))
+	{
+		if ((r = mem_region_create(HANDLE_CHUNK * sizeof(struct mm_handle))) == NULL)
+			return (NULL);
+		*(mem_region_t **)mem_region_sbrk(r, sizeof(struct mm_handle)) = handle_region;
+		handle_region = r;
 	}
+	return (mem_region_sbrk(handle_region, sizeof(struct mm_handle)));
+}
 
-	return biggerBuffer;
+/* Effects: mark the allocated block "bp" as owned by "tag" and count it. */
+static void tag_block(void *bp, unsigned int tag)
+{
+	PUT(HDRP(bp), GET(HDRP(bp)) | ((uintptr_t)tag << TAG_SHIFT));
+	PUT(FTRP(bp), GET(FTRP(bp)) | ((uintptr_t)tag << TAG_SHIFT));
+	tags_used = true;
+	tag_charge(tag, GET_SIZE(HDRP(bp)));
+}
+
+/* Effects: returns whether "bytes" more can be charged to "tag" within its hard limit.  If not the limit callback is
+ * called first, it may free blocks of the tag to make room. */
+static bool tag_admits(unsigned int tag, size_t bytes)
+{
+	struct tag_stats *t = &tags[tag];
 
+	if (t->hard_limit == 0 || (t->live <= t->hard_limit && bytes <= t->hard_limit - t->live))
+		return (true);
+	if (tag_limit_callback != NULL)
+		tag_limit_callback(tag, MM_LIMIT_HARD, t->live);
+	return (t->live <= t->hard_limit && bytes <= t->hard_limit - t->live);
 }
 
+/* Effects: add "bytes" to the live bytes of "tag", calling the limit callback if they go past the soft limit. */
+static void tag_charge(unsigned int tag, size_t bytes)
+{
+	struct tag_stats *t = &tags[tag];
+	size_t before = t->live;
 
+	t->live += bytes;
+	if (t->soft_limit != 0 && before <= t->soft_limit && t->live > t->soft_limit && tag_limit_callback != NULL)
+		tag_limit_callback(tag, MM_LIMIT_SOFT, t->live);
+}
 
+/* Effects: address of the last byte of the current heap. */
+static void *heap_hi(void)
+{
+	if (heap->region == NULL)
+		return mem_heap_hi();
+	return mem_region_hi(heap->region);
+}
 
-/*
- * The following routines are internal helper routines.
- */
+/* Effects: move the cursors of mm_compact and of the incremental checker to the start of the block "bp" of "size"
+ * bytes if they are inside it, as they are when the blocks they were at have been merged into it. */
+static inline void cursors_out_of(char *bp, size_t size)
+{
+	if (compact_cursor > bp && compact_cursor < bp + size)
+		compact_cursor = bp;
+	if (check_cursor > bp && check_cursor < bp + size)
+		check_cursor = bp;
+}
 
 /*
  * Requires:
@@ -461,26 +3006,36 @@ coalesce(void *bp)
 	bool next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
 	size_t size = GET_SIZE(HDRP(bp));
 	int class = get_class(bp);
+	int merge;
+	TRACE_START(t);
 
 	if (prev_alloc && next_alloc) {                 /* Case 1 */
 		add_block_in_segregated_list(bp , class);		
+		cursors_out_of(bp, size);			//mm_free_batch merged the blocks after bp
+		TRACE(coalesce, class, size, 1, t);
 		return (bp);
 	} else if (prev_alloc && !next_alloc) {         /* Case 2 */
+		merge = 2;
 		remove_from_list( NEXT_BLKP(bp), get_class(NEXT_BLKP(bp)));	
+		STAT(heap->stats.coalesces++);
 		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
 		PUT(HDRP(bp), PACK(size, 0));
 		PUT(FTRP(bp), PACK(size, 0));
 		add_block_in_segregated_list(bp , get_class(bp));		//class may be changed
 	} else if (!prev_alloc && next_alloc) {         /* Case 3 */
+		merge = 3;
 		remove_from_list( PREV_BLKP(bp), get_class(PREV_BLKP(bp)));		
+		STAT(heap->stats.coalesces++);
 		size += GET_SIZE(HDRP(PREV_BLKP(bp)));
 		PUT(FTRP(bp), PACK(size, 0));
 		PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
 		bp = PREV_BLKP(bp);
 		add_block_in_segregated_list(bp , get_class(bp));		//class may be changed
 	} else {                                        /* Case 4 */
+		merge = 4;
 		remove_from_list( NEXT_BLKP(bp), get_class(NEXT_BLKP(bp)));	
 		remove_from_list( PREV_BLKP(bp), get_class(PREV_BLKP(bp)));		
+		STAT(heap->stats.coalesces += 2);
 		size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
 			GET_SIZE(FTRP(NEXT_BLKP(bp)));
 		PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
@@ -488,6 +3043,8 @@ coalesce(void *bp)
 		bp = PREV_BLKP(bp);
 		add_block_in_segregated_list(bp , get_class(bp));		//class may be changed
 	}
+	cursors_out_of(bp, size);				//the compactor and checker must not be left inside the block
+	TRACE(coalesce, get_class(bp), size, merge, t);
 	return (bp);
 }
 
@@ -502,11 +3059,13 @@ extend_heap(size_t words)
 {
 	void *bp;
 	size_t size;
+	TRACE_START(t);
 
 	/* Allocate an even number of words to maintain alignment. */
 	size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-	if ((bp = mem_sbrk(size)) == (void *)-1)  
+	if ((bp = heap_sbrk(size)) == (void *)-1)  
 		return (NULL);
+	STAT(heap->stats.extends++);
 
 	/* Initialize free block header/footer and the epilogue header. */
 	PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
@@ -514,7 +3073,9 @@ extend_heap(size_t words)
 	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */			
 
 	/* Coalesce if the previous block was free. */
-	return (coalesce(bp));
+	bp = coalesce(bp);
+	TRACE(extend, -1, size, 0, t);
+	return (bp);
 }
 
 /*
@@ -528,21 +3089,38 @@ extend_heap(size_t words)
 
 static void* find_fit_by_class_pseudo_best_fit(size_t asize , int class)
 {
+#if FREE_INDEX
+	//exact best fit over the sizes array of the class, no block is touched until one is chosen
+	const struct index_class *ic = &heap->index[class];
+	size_t best;
+
+	if(ic->count == 0)
+		return (NULL);
+	TRACE_START(t);
+	best = best_fit_kernel(ic->sizes, ic->count, asize);
+	TRACE(find_fit, class, asize, ic->count, t);
+	return (ic->sizes[best] >= asize ? ic->blocks[best] : NULL);
+#else
 
 	//curr points to the word after header of current block
-	unsigned int** curr = (unsigned int**)segregation_classes[class] ;		
+	unsigned int** curr = (unsigned int**)heap->segregation_classes[class] ;		
 	//segregation classes array pointers point to the word following the header of first item in list.
 
 	size_t min_padding = 999999999, padding;
 	unsigned int** best = NULL ;
-	int count = 0 , max_suitable = 5;		//max no of suitable blocks checked in pseudo best fit is 5 
+	int count = 0 , max_suitable = MAX_SUITABLE;	//max no of suitable blocks checked in pseudo best fit is 5 by default
+	size_t examined = 0;
 
+	if(curr == NULL)				//empty classes are passed over without a trace record
+		return (NULL);
+	TRACE_START(t);
 	while(curr!=NULL)				//while we don't reach epilogue block
 	{
+		examined++;
 		if (asize <= GET_SIZE(HDRP(curr)))		
 		{							// 'suitable' block
-			if(count > max_suitable)			// if 5 suitable blocks have been found return the best one.
-				return (best);
+			if(count > max_suitable)			// if enough suitable blocks have been found return the best one.
+				break;
 
 			padding = GET_SIZE(HDRP(curr)) - asize ;
 
@@ -556,9 +3134,322 @@ static void* find_fit_by_class_pseudo_best_fit(size_t asize , int class)
 	}	
 
 	//we have finished searching the given class but did not find any appropriate free block. return best=NULL
+	TRACE(find_fit, class, asize, examined, t);
 	return best;
+#endif
+}
+
+/* Effects : first free block of a class, NULL if it has none. With the free lists and the index alike, the checkers
+ * go through a class with free_list_first and free_list_next. */
+static void* free_list_first(int class)
+{
+#if FREE_INDEX
+	return (heap->index[class].count > 0 ? heap->index[class].blocks[0] : NULL);
+#else
+	return (heap->segregation_classes[class]);
+#endif
+}
+
+/* Effects : free block after "bp" in its class, NULL at the end */
+static void* free_list_next(void* bp, int class)
+{
+#if FREE_INDEX
+	size_t slot = INDEX_SLOT(bp) + 1;
+
+	return (slot < heap->index[class].count ? heap->index[class].blocks[slot] : NULL);
+#else
+	(void)class;
+	return ((void*)EXP_GET_NEXT_BLKP(bp));
+#endif
+}
+
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+/* Effects : height of the tower of a block added to an address ordered list, 0 for none: each level is reached
+ * with probability 1/4 from the one below, the highest is "most" (or SKIP_LEVELS - 1). */
+static int skip_height(int most)
+{
+	static uint64_t state = 88172645463325252ull;		//xorshift
+	uint64_t r;
+	int height = 0;
+
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	if(most > SKIP_LEVELS - 1)
+		most = SKIP_LEVELS - 1;
+	for(r = state; height < most && (r & 3) == 0; r >>= 2)
+		height++;
+	return height;
+}
+
+/* Effects : a tower for the current heap, taken from its free towers or else from its newest region of towers,
+ * making a region when it is full.  Returns NULL if no region can be made. */
+static struct skip_tower *skip_tower_new(void)
+{
+	struct skip_tower *tower = heap->free_towers;
+	mem_region_t *r;
+
+	if(tower != NULL)
+	{
+		heap->free_towers = tower->next[0];
+		return (tower);
+	}
+	if(heap->tower_region == NULL || mem_region_size(heap->tower_region) == SKIP_CHUNK * sizeof(struct skip_tower))
+	{
+		if((r = mem_region_create(SKIP_CHUNK * sizeof(struct skip_tower))) == NULL)
+			return (NULL);
+		*(mem_region_t **)mem_region_sbrk(r, sizeof(struct skip_tower)) = heap->tower_region;
+		heap->tower_region = r;
+	}
+	return (mem_region_sbrk(heap->tower_region, sizeof(struct skip_tower)));
+}
+
+/* Requires : "bp" carries SKIP_TOWER and is in the list of "class".
+ * Effects : unlink the tower of "bp" from every level it reaches, going down from the top as an insertion does,
+ * and give it back to the free towers. */
+static void skip_unlink(void *bp, int class)
+{
+	struct skip_tower **heads = SEG_SKIP(class), **link;
+	struct skip_tower *below = NULL, *tower = NULL;
+	int level;
+
+	for(level = heap->skip_top[class] - 1; level >= 0; level--)
+	{
+		link = (below != NULL) ? &below->next[level] : &heads[level];
+		while(*link != NULL && (*link)->block < bp)
+		{
+			below = *link;
+			link = &below->next[level];
+		}
+		if(*link != NULL && (*link)->block == bp)
+		{
+			tower = *link;
+			*link = tower->next[level];
+		}
+	}
+	while(heap->skip_top[class] > 0 && heads[heap->skip_top[class] - 1] == NULL)
+		heap->skip_top[class]--;
+	PUT(HDRP(bp), GET(HDRP(bp)) & ~(uintptr_t)SKIP_TOWER);
+	PUT(FTRP(bp), GET(FTRP(bp)) & ~(uintptr_t)SKIP_TOWER);
+	tower->next[0] = heap->free_towers;
+	heap->free_towers = tower;
+}
+
+#if ADAPTIVE_CLASSES
+/* Effects : give the towers of "class", whose list is being emptied, back to the free towers.  Every tower is on
+ * the first level, so a walk of it finds them all; the blocks keep SKIP_TOWER until they are added again. */
+static void skip_clear(int class)
+{
+	struct skip_tower **heads = SEG_SKIP(class), *tower, *next;
+	int level;
+
+	for(tower = heads[0]; tower != NULL; tower = next)
+	{
+		next = tower->next[0];
+		tower->next[0] = heap->free_towers;
+		heap->free_towers = tower;
+	}
+	for(level = 0; level < SKIP_LEVELS - 1; level++)
+		heads[level] = NULL;
+	heap->list_length[class] = 0;
+	heap->skip_top[class] = 0;
+}
+#endif
+
+/* Effects : destroy the regions of towers of "h", whose lists are about to be emptied */
+static void skip_release(struct mm_heap *h)
+{
+	while(h->tower_region != NULL)
+	{
+		mem_region_t *prev = *(mem_region_t **)mem_region_lo(h->tower_region);
+
+		mem_region_destroy(h->tower_region);
+		h->tower_region = prev;
+	}
+	h->free_towers = NULL;
+	memset(h->list_length, 0, sizeof(h->list_length));
+	memset(h->skip_top, 0, sizeof(h->skip_top));
+}
+#endif
+
+#if FREE_INDEX
+/* Effects : most free blocks a class can have in a heap of "max_size" bytes, from the smallest block of the class */
+static size_t index_capacity(int class, size_t max_size)
+{
+	static const size_t class_max_sizes[NO_SEG_CLASSES - 1] = {
+		MAXSIZE_CLASS_0, MAXSIZE_CLASS_1, MAXSIZE_CLASS_2, MAXSIZE_CLASS_3, MAXSIZE_CLASS_4,
+		MAXSIZE_CLASS_5, MAXSIZE_CLASS_6, MAXSIZE_CLASS_7, MAXSIZE_CLASS_8
+	};
+	size_t min_size = (class == 0) ? 2 * DSIZE : class_max_sizes[class - 1] + DSIZE;
+
+	return (max_size / min_size + 1);
+}
+
+/* Effects : size of the index region of a heap of "max_size" bytes.  Every class gets room for as many blocks as
+ * it can ever have, about max_size bytes in all, so the arrays never move; only the pages that are used of
+ * them take memory. */
+static size_t index_region_size(size_t max_size)
+{
+	size_t size = NO_SEG_CLASSES * sizeof(struct index_class);
+	int i;
+
+	for(i = 0; i < NO_SEG_CLASSES; i++)
+		size += index_capacity(i, max_size) * (sizeof(size_t) + sizeof(void*));
+	return (size);
+}
+
+/*
+ * The best fit kernels.  Each returns the first slot whose size is the smallest of those that are at least "asize", or
+ * some slot whose size is too small if there is none; "n" is not zero.  The padding size - asize is computed as an
+ * unsigned number, so a block that is too small gets a padding larger than any block could have and the search is
+ * just a minimum.  An exact fit ends the search.
+ */
+static size_t best_fit_scalar(const size_t *sizes, size_t n, size_t asize)
+{
+	size_t i, best = 0, min_padding = sizes[0] - asize;
+
+	for(i = 1; i < n && min_padding != 0; i++)
+	{
+		if(sizes[i] - asize < min_padding)
+		{
+			min_padding = sizes[i] - asize;
+			best = i;
+		}
+	}
+	return (best);
+}
+
+#if INDEX_SIMD
+/* AVX2 has no unsigned 64 bit compare, the paddings are compared signed with their top bit flipped. Each lane keeps
+ * its own minimum and the first slot of it, the lanes are merged at the end taking the first slot of equal minima,
+ * so that ties go to the slot the scalar kernel would pick. */
+__attribute__((target("avx2")))
+static size_t best_fit_avx2(const size_t *sizes, size_t n, size_t asize)
+{
+	const __m256i want = _mm256_set1_epi64x((long long)asize);
+	const __m256i flip = _mm256_set1_epi64x((long long)1 << 63);
+	const __m256i step = _mm256_set1_epi64x(4);
+	__m256i slot = _mm256_set_epi64x(3, 2, 1, 0);
+	__m256i min_key = _mm256_set1_epi64x(-1 ^ ((long long)1 << 63));	//largest padding, flipped
+	__m256i min_slot = _mm256_setzero_si256();
+	size_t keys[4], slots[4];
+	size_t i, best = 0, min_padding = (size_t)-1;
+	int lane;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		__m256i padding = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(sizes + i)), want);
+		__m256i key = _mm256_xor_si256(padding, flip);
+		__m256i smaller = _mm256_cmpgt_epi64(min_key, key);
+
+		min_key = _mm256_blendv_epi8(min_key, key, smaller);
+		min_slot = _mm256_blendv_epi8(min_slot, slot, smaller);
+		slot = _mm256_add_epi64(slot, step);
+		if(!_mm256_testz_si256(_mm256_cmpeq_epi64(padding, _mm256_setzero_si256()), _mm256_set1_epi64x(-1)))
+			break;			//an exact fit, it is the minimum of its lane
+	}
+	_mm256_storeu_si256((__m256i *)keys, _mm256_xor_si256(min_key, flip));
+	_mm256_storeu_si256((__m256i *)slots, min_slot);
+	for(lane = 0; lane < 4; lane++)
+	{
+		if(keys[lane] < min_padding || (keys[lane] == min_padding && slots[lane] < best))
+		{
+			min_padding = keys[lane];
+			best = slots[lane];
+		}
+	}
+	for(; i < n && min_padding != 0; i++)
+	{
+		if(sizes[i] - asize < min_padding)
+		{
+			min_padding = sizes[i] - asize;
+			best = i;
+		}
+	}
+	return (best);
+}
+
+/* AVX-512 compares unsigned 64 bit numbers into a mask directly. */
+__attribute__((target("avx512f")))
+static size_t best_fit_avx512(const size_t *sizes, size_t n, size_t asize)
+{
+	const __m512i want = _mm512_set1_epi64((long long)asize);
+	const __m512i step = _mm512_set1_epi64(8);
+	__m512i slot = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+	__m512i min_padding_v = _mm512_set1_epi64(-1);
+	__m512i min_slot = _mm512_setzero_si512();
+	size_t paddings[8], slots[8];
+	size_t i, best = 0, min_padding = (size_t)-1;
+	int lane;
+
+	for(i = 0; i + 8 <= n; i += 8)
+	{
+		__m512i padding = _mm512_sub_epi64(_mm512_loadu_si512(sizes + i), want);
+		__mmask8 smaller = _mm512_cmplt_epu64_mask(padding, min_padding_v);
+
+		min_padding_v = _mm512_mask_mov_epi64(min_padding_v, smaller, padding);
+		min_slot = _mm512_mask_mov_epi64(min_slot, smaller, slot);
+		slot = _mm512_add_epi64(slot, step);
+		if(_mm512_cmpeq_epu64_mask(padding, _mm512_setzero_si512()))
+			break;			//an exact fit, it is the minimum of its lane
+	}
+	_mm512_storeu_si512(paddings, min_padding_v);
+	_mm512_storeu_si512(slots, min_slot);
+	for(lane = 0; lane < 8; lane++)
+	{
+		if(paddings[lane] < min_padding || (paddings[lane] == min_padding && slots[lane] < best))
+		{
+			min_padding = paddings[lane];
+			best = slots[lane];
+		}
+	}
+	for(; i < n && min_padding != 0; i++)
+	{
+		if(sizes[i] - asize < min_padding)
+		{
+			min_padding = sizes[i] - asize;
+			best = i;
+		}
+	}
+	return (best);
+}
+#endif
+
+/* Effects : pick the widest kernel the processor supports, then run it */
+static size_t best_fit_dispatch(const size_t *sizes, size_t n, size_t asize)
+{
+	best_fit_kernel = best_fit_scalar;
+#if INDEX_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		best_fit_kernel = best_fit_avx512;
+	else if (__builtin_cpu_supports("avx2"))
+		best_fit_kernel = best_fit_avx2;
+#endif
+	return (best_fit_kernel(sizes, n, asize));
+}
+
+/* Effects : lay out an empty index for the current heap in its index region. Returns 0 on success and -1 otherwise. */
+static int index_init(void)
+{
+	mem_region_t *r = heap->index_region;
+	size_t cap;
+	int i;
 
+	mem_region_reset_brk(r);
+	if ((heap->index = mem_region_sbrk(r, NO_SEG_CLASSES * sizeof(struct index_class))) == (void *)-1)
+		return (-1);
+	for(i = 0; i < NO_SEG_CLASSES; i++)
+	{
+		cap = index_capacity(i, heap->max_size);
+		heap->index[i].count = 0;
+		if ((heap->index[i].sizes = mem_region_sbrk(r, cap * sizeof(size_t))) == (void *)-1 ||
+		    (heap->index[i].blocks = mem_region_sbrk(r, cap * sizeof(void*))) == (void *)-1)
+			return (-1);
+	}
+	return (0);
 }
+#endif
 
 
 /* 
@@ -569,12 +3460,54 @@ static void* find_fit_by_class_pseudo_best_fit(size_t asize , int class)
  *   Place a block of "asize" bytes at the start of the free block "bp" and
  *   split that block if the remainder would be at least the minimum block
  *   size. The splitted block fragment is added to the appropriate segregation class 
+ *   With SPLIT_DIRECTION_BY_SIZE a block of SPLIT_LARGE_SIZE bytes or more is
+ *   placed at the end of the free block instead.  Returns the placed block.
  */
-static void place_segregated_list(void* bp ,size_t asize)
+static void* place_segregated_list(void* bp ,size_t asize)
+{
+	TRACE_START(t);
+	size_t csize = GET_SIZE(HDRP(bp));
+
+#if SPLIT_DIRECTION == SPLIT_DIRECTION_BY_SIZE
+	if (asize >= SPLIT_LARGE_SIZE)
+		bp = place_at_end(bp , asize);
+	else
+		bp = place_at_start(bp , asize);
+#else
+	bp = place_at_start(bp , asize);
+#endif
+	TRACE(place, get_class_from_size(csize), asize, csize - asize, t);
+	return (bp);
+}
+
+/* Effects : place_segregated_list at the end of the free block, the fragment stays at the start */
+static void* place_at_end(void* bp ,size_t asize)
+{
+	size_t csize = GET_SIZE(HDRP(bp));   
+
+	if ((csize - asize) >= MAX(SPLIT_THRESHOLD, 2 * DSIZE)) {
+		STAT(heap->stats.splits++);
+		PUT(HDRP(bp), PACK(csize - asize, 0));
+		PUT(FTRP(bp), PACK(csize - asize, 0));
+		add_block_in_segregated_list(bp , get_class_from_size(csize - asize));
+
+		bp = NEXT_BLKP(bp);
+		PUT(HDRP(bp), PACK(asize, 1));
+		PUT(FTRP(bp), PACK(asize, 1));
+	} else {
+		PUT(HDRP(bp), PACK(csize, 1));
+		PUT(FTRP(bp), PACK(csize, 1));
+	}
+	return (bp);
+}
+
+/* Effects : place_segregated_list at the start of the free block, whatever the split direction */
+static void* place_at_start(void* bp ,size_t asize)
 {
 	size_t csize = GET_SIZE(HDRP(bp));   
 
-	if ((csize - asize) >= (2 *DSIZE)) { 
+	if ((csize - asize) >= MAX(SPLIT_THRESHOLD, 2 * DSIZE)) { 
+		STAT(heap->stats.splits++);
 		PUT(HDRP(bp), PACK(asize, 1));
 		PUT(FTRP(bp), PACK(asize, 1));
 
@@ -591,17 +3524,41 @@ static void place_segregated_list(void* bp ,size_t asize)
 
 		add_block_in_segregated_list(bp , i);
 
+		return (PREV_BLKP(bp));
 	} else {
 		PUT(HDRP(bp), PACK(csize, 1));				//if no spliting feasible
 		PUT(FTRP(bp), PACK(csize, 1));
 	}
 
-
+	return (bp);
 }
 
 
 
 
+/*
+ * Requires:
+ *   "bp" is the address of an allocated block of at least "asize" bytes.
+ *
+ * Effects:
+ *   Shrink the block to "asize" bytes if the rest would be at least the
+ *   minimum block size, and free the rest.
+ */
+static void split_block_tail(void* bp, size_t asize)
+{
+	size_t csize = GET_SIZE(HDRP(bp));
+
+	if ((csize - asize) >= (2 * DSIZE)) {
+		STAT(heap->stats.splits++);
+		PUT(HDRP(bp), PACK(asize, 1));
+		PUT(FTRP(bp), PACK(asize, 1));
+		bp = NEXT_BLKP(bp);
+		PUT(HDRP(bp), PACK(csize - asize, 0));
+		PUT(FTRP(bp), PACK(csize - asize, 0));
+		coalesce(bp);
+	}
+}
+
 /* 
  * The remaining routines are heap consistency checker routines. 
  */
@@ -619,7 +3576,7 @@ checkblock(void *bp)
 
 	if ((uintptr_t)bp % DSIZE)
 		printf("Error: %p is not doubleword aligned\n", bp);
-	if (GET(HDRP(bp)) != GET(FTRP(bp)))
+	if ((GET(HDRP(bp)) & ~(uintptr_t)FREED) != GET(FTRP(bp)))
 		printf("Error: header does not match footer\n");
 }
 
@@ -635,9 +3592,9 @@ static void check_pointers_in_heap(bool verbose)
 	// we check the segregation list pointers
 	for(i=0 ; i < NO_SEG_CLASSES ; i++)
 	{
-		if(segregation_classes[i]==NULL)
+		if(heap->segregation_classes[i]==NULL)
 			continue;
-		else if((void*)segregation_classes[i] > mem_heap_lo() && (void*)segregation_classes[i] < mem_heap_hi())
+		else if((void*)heap->segregation_classes[i] > heap_lo() && (void*)heap->segregation_classes[i] < heap_hi())
 			continue;
 		else
 			{
@@ -646,8 +3603,30 @@ static void check_pointers_in_heap(bool verbose)
 				printf("segregation_classes[%d] contains pointer out of heap",i);
 			}	
 	}
+#if FREE_INDEX
+	// with the index we check that each free block's slot holds the block and its size
+	unsigned int** curr = (unsigned int**)heap->heap_listp ;
+	struct index_class *ic;
+	size_t slot;
+
+	while( GET_SIZE(curr) != 0)
+	{
+		if(GET_ALLOC(HDRP(curr)) == 0)
+		{
+			ic = &heap->index[get_class(curr)];
+			slot = INDEX_SLOT(curr);
+			if(slot >= ic->count || ic->blocks[slot] != (void*)curr || ic->sizes[slot] != GET_SIZE(HDRP(curr)))
+				{
+					printf("Error : free block's index slot does not match the block !\n");
+				if(verbose)
+					printblock(curr);
+				}
+		}
+		curr = (unsigned int**)NEXT_BLKP(curr);
+	}
+#else
 	// now we check the 2 pointers stored in each free block.
-	unsigned int** curr = (unsigned int**)heap_listp ;
+	unsigned int** curr = (unsigned int**)heap->heap_listp ;
 	void* next_freeptr;
 	void* prev_freeptr ;
 
@@ -657,7 +3636,7 @@ static void check_pointers_in_heap(bool verbose)
 		{	
 			prev_freeptr = (void*)EXP_GET_PREV_BLKP(curr);
 			next_freeptr = (void*)EXP_GET_NEXT_BLKP(curr);
-			if(prev_freeptr > mem_heap_lo() && prev_freeptr < mem_heap_hi() )	
+			if(prev_freeptr > heap_lo() && prev_freeptr < heap_hi() )	
 			{}
 			else
 			{
@@ -668,7 +3647,7 @@ static void check_pointers_in_heap(bool verbose)
 						printblock(curr);					
 					}
 			}
-			if(next_freeptr > mem_heap_lo() && next_freeptr < mem_heap_hi())	
+			if(next_freeptr > heap_lo() && next_freeptr < heap_hi())	
 			{}
 			else
 			{
@@ -682,7 +3661,7 @@ static void check_pointers_in_heap(bool verbose)
 		}		
 		curr = (unsigned int**)NEXT_BLKP(curr);				//move on to the next block in heap
 	}
-
+#endif
 }
 
 
@@ -692,7 +3671,7 @@ static void check_pointers_in_heap(bool verbose)
 void check_freelist_completeness(bool verbose)
 {
 	// now we check the 2 pointers stored in each free block.
-	unsigned int** curr = (unsigned int**)heap_listp ;				// heap block list iterator
+	unsigned int** curr = (unsigned int**)heap->heap_listp ;				// heap block list iterator
 	int class;
 	unsigned int** curr1 ;								// free block list iterator 
 
@@ -701,14 +3680,14 @@ void check_freelist_completeness(bool verbose)
 		if(GET_ALLOC(HDRP(curr)) == 0)						//if its free check if its present in respective free 												//list class
 		{	
 			class = get_class(curr);
-			curr1 = (unsigned int**)segregation_classes[class];	
+			curr1 = (unsigned int**)free_list_first(class);	
 
 			// loop through the list and check if curr is present.
 			while(curr1!=NULL)
 			{
 				if(curr1 == curr)
 					break;
-				curr1 = (unsigned int**)EXP_GET_NEXT_BLKP(curr1);				
+				curr1 = (unsigned int**)free_list_next(curr1, class);				
 			}
 
 			if(curr1 == NULL)
@@ -729,7 +3708,7 @@ void mm_check_free(bool verbose){
 
 	int i;
 	for(i = 0; i < NO_SEG_CLASSES; i++) {
-		unsigned int **bp = (unsigned int **)segregation_classes[i]; //start from the beginning
+		unsigned int **bp = (unsigned int **)free_list_first(i); //start from the beginning
 		while (bp != NULL) { //go through the linked list
 
 			//check - is the block marked as free?
@@ -740,7 +3719,7 @@ void mm_check_free(bool verbose){
 					if(verbose)
 						printblock(bp);				
 				}
-			bp  = (unsigned int **)EXP_GET_NEXT_BLKP(bp);
+			bp  = (unsigned int **)free_list_next(bp, i);
 		}
 	} 
 }
@@ -750,7 +3729,7 @@ void mm_check_coalescing(bool verbose){
 
 	int i;
 	for(i = 0; i < NO_SEG_CLASSES; i++) {
-		unsigned int **bp = (unsigned int **)segregation_classes[i]; //start from the beginning
+		unsigned int **bp = (unsigned int **)free_list_first(i); //start from the beginning
 		while (bp != NULL) { //go through the linked list
 			unsigned int **prev = (unsigned int **)PREV_BLKP(bp);
 			unsigned int **next = (unsigned int **)NEXT_BLKP(bp);
@@ -762,7 +3741,7 @@ void mm_check_coalescing(bool verbose){
 					if(verbose)
 						printblock(bp);				
 				}
-			bp  = (unsigned int **)EXP_GET_NEXT_BLKP(bp);
+			bp  = (unsigned int **)free_list_next(bp, i);
 		}
 	} 
 }
@@ -780,14 +3759,14 @@ checkheap(bool verbose)
 	void *bp;
 
 	if (verbose)
-		printf("Heap (%p):\n", heap_listp);
+		printf("Heap (%p):\n", heap->heap_listp);
 
-	if (GET_SIZE(HDRP(heap_listp)) != DSIZE ||
-			!GET_ALLOC(HDRP(heap_listp)))
+	if (GET_SIZE(HDRP(heap->heap_listp)) != DSIZE ||
+			!GET_ALLOC(HDRP(heap->heap_listp)))
 		printf("Bad prologue header\n");
-	checkblock(heap_listp);
+	checkblock(heap->heap_listp);
 
-	for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+	for (bp = heap->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
 		if (verbose)
 			printblock(bp);
 		checkblock(bp);
@@ -834,6 +3813,243 @@ printblock(void *bp)
 			fsize, (falloc ? 'a' : 'f'));
 }
 
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Check the next "budget" blocks of the default heap, as a slice of a
+ *   pass which checks every free list entry and then every block once, in
+ *   O(n) over the pass.  Each entry and block is checked against its
+ *   neighbours in its list and in the heap, and a free block met by the
+ *   heap walk must carry the mark of the list walk.  The first call starts
+ *   the checker.  Errors are written to stderr, without allocating, so the
+ *   checker can run in a program on libmm.so.  A slice ends at the end of a
+ *   pass, or where a bad block size makes the pass start again, so a budget
+ *   of SIZE_MAX finishes the pass under way and the next such call checks
+ *   the whole heap.  Returns the number of errors found.
+ */
+int mm_check_slice(size_t budget)
+{
+	int errors = 0;
+	char *bp;
+	size_t size;
+
+	if (!check_running)
+	{
+		check_running = true;
+		check_restart();
+	}
+	for (; budget > 0; budget--)
+	{
+		if (check_phase == CHECK_LISTS)
+		{
+#if FREE_INDEX
+			if (check_steps < heap->index[check_class].count)
+#else
+			if (check_entry != NULL)
+#endif
+				errors += check_list_entry(check_entry);
+			else if (++check_class < NO_SEG_CLASSES)
+			{
+				check_entry = free_list_first(check_class);
+				check_steps = 0;
+			}
+			else
+			{
+				check_phase = CHECK_HEAP;
+				check_cursor = NEXT_BLKP(heap->heap_listp);
+			}
+			continue;
+		}
+
+		bp = check_cursor;
+		if (bp == (char *)heap_hi() + 1)		//the epilogue, the pass is over
+		{
+			if (GET_SIZE(HDRP(bp)) != 0 || !GET_ALLOC(HDRP(bp)))
+			{
+				check_report("bad epilogue header", bp);
+				errors++;
+			}
+			check_mark ^= CHECK_MARK;
+			check_restart();
+			break;					//a slice never goes on into the next pass
+		}
+		size = GET_SIZE(HDRP(bp));
+		if (size < 2 * DSIZE || bp + size > (char *)heap_hi() + 1)
+		{
+			check_report("block size runs out of the heap, the pass starts again", bp);
+			errors++;
+			check_restart();
+			break;					//nor the restarted one, which would meet the block again
+		}
+		errors += check_block(bp);
+		check_cursor = bp + size;
+	}
+	return (errors);
+}
+
+/* Effects : start a pass of mm_check_slice over, at the first list */
+static void check_restart(void)
+{
+	check_phase = CHECK_LISTS;
+	check_class = 0;
+	check_entry = free_list_first(0);
+	check_steps = 0;
+	check_cursor = NULL;
+}
+
+/* Effects : check the entry "bp" of the list walk (with FREE_INDEX the slot check_steps of the class), mark it
+ * and move the walk on.  Returns the number of errors. */
+static int check_list_entry(void *bp)
+{
+	int errors = 0;
+#if FREE_INDEX
+	struct index_class *ic = &heap->index[check_class];
+	size_t slot = check_steps++;
+
+	bp = ic->blocks[slot];
+	if (!check_in_heap(bp))
+	{
+		check_report("index entry points out of the heap", bp);
+		return (1);
+	}
+	if (GET_ALLOC(HDRP(bp)) || INDEX_SLOT(bp) != slot || ic->sizes[slot] != GET_SIZE(HDRP(bp)) ||
+	    get_class(bp) != check_class)
+	{
+		check_report("index entry does not match its block", bp);
+		errors++;
+	}
+#else
+	void *next;
+
+	check_entry = NULL;				//the rest of the class cannot be trusted until bp is checked
+	if (!check_in_heap(bp))
+	{
+		check_report("free list entry points out of the heap", bp);
+		return (1);
+	}
+	if (GET_ALLOC(HDRP(bp)) || get_class(bp) != check_class)
+	{
+		check_report("free list entry is not a free block of its class", bp);
+		return (1);
+	}
+	if ((EXP_GET_PREV_BLKP(bp) == 0) != ((void*)heap->segregation_classes[check_class] == bp))
+	{
+		check_report("free list entry without a predecessor is not the head of its list", bp);
+		errors++;
+	}
+	if (++check_steps > (size_t)((char *)heap_hi() - (char *)heap_lo()) / (2 * DSIZE))
+	{
+		check_report("free list is longer than the heap can hold, it has a cycle", bp);
+		return (errors + 1);
+	}
+	next = (void*)EXP_GET_NEXT_BLKP(bp);
+	if (next != NULL && (!check_in_heap(next) || (void*)EXP_GET_PREV_BLKP(next) != bp))
+	{
+		check_report("free list entry's next link is broken", bp);
+		errors++;
+		next = NULL;
+	}
+#if LIST_ORDER == LIST_ORDER_ADDRESS
+	if (next != NULL && next < bp)
+	{
+		check_report("address ordered free list is out of order", bp);
+		errors++;
+	}
+#endif
+	PUT(HDRP(bp), (GET(HDRP(bp)) & ~(uintptr_t)CHECK_MARK) | check_mark);
+	PUT(FTRP(bp), (GET(FTRP(bp)) & ~(uintptr_t)CHECK_MARK) | check_mark);
+	check_entry = next;
+#endif
+	return (errors);
+}
+
+/* Effects : check the block "bp" met by the heap walk, whose size has been found to fit in the heap.  Returns
+ * the number of errors. */
+static int check_block(void *bp)
+{
+	int errors = 0;
+
+	if ((GET(HDRP(bp)) & ~(uintptr_t)FREED) != GET(FTRP(bp)))
+	{
+		check_report("header does not match footer", bp);
+		errors++;
+	}
+	if (GET_ALLOC(HDRP(bp)))
+		return (errors);
+	if (!GET_ALLOC(HDRP(NEXT_BLKP(bp))))
+	{
+		check_report("free block has escaped coalescing", bp);
+		errors++;
+	}
+#if FREE_INDEX
+	struct index_class *ic = &heap->index[get_class(bp)];
+	size_t slot = INDEX_SLOT(bp);
+
+	if (slot >= ic->count || ic->blocks[slot] != bp)
+	{
+		check_report("free block is not in the index", bp);
+		errors++;
+	}
+#else
+	if ((GET(HDRP(bp)) & CHECK_MARK) != check_mark)
+	{
+		check_report("free block was not reached from the head of its list", bp);
+		errors++;
+	}
+	errors += check_links(bp);
+#endif
+	return (errors);
+}
+
+#if !FREE_INDEX
+/* Effects : check that the list neighbours of the free block "bp" link back to it.  Returns the number of errors. */
+static int check_links(void *bp)
+{
+	int class = get_class(bp);
+	void *prev = (void*)EXP_GET_PREV_BLKP(bp);
+	void *next = (void*)EXP_GET_NEXT_BLKP(bp);
+	int errors = 0;
+
+	if (prev == NULL ? (void*)heap->segregation_classes[class] != bp :
+	    !check_in_heap(prev) || GET_ALLOC(HDRP(prev)) || (void*)EXP_GET_NEXT_BLKP(prev) != bp)
+	{
+		check_report("free block's prev link is broken", bp);
+		errors++;
+	}
+	if (next != NULL && (!check_in_heap(next) || GET_ALLOC(HDRP(next)) || (void*)EXP_GET_PREV_BLKP(next) != bp))
+	{
+		check_report("free block's next link is broken", bp);
+		errors++;
+	}
+#if LIST_ORDER == LIST_ORDER_FIFO
+	if (next == NULL && (void*)SEG_TAIL(class) != bp)
+	{
+		check_report("last free block of a list is not its tail", bp);
+		errors++;
+	}
+#endif
+	return (errors);
+}
+#endif
+
+/* Effects : true if "p" may be the address of a block of the current heap */
+static bool check_in_heap(void *p)
+{
+	return ((char *)p > (char *)heap_lo() && (char *)p < (char *)heap_hi() && (uintptr_t)p % DSIZE == 0);
+}
+
+/* Effects : write an error of the incremental checker to stderr, with a buffer on the stack */
+static void check_report(const char *what, void *bp)
+{
+	char line[160];
+	int n = snprintf(line, sizeof(line), "mm_check_slice: %s (block %p)\n", what, bp);
+
+	if (n > 0 && write(STDERR_FILENO, line, MIN((size_t)n, sizeof(line) - 1)) < 0)
+		return;
+}
+
 /*
  * The last lines of this file configures the behavior of the "Tab" key in
  * emacs.  Emacs has a rudimentary understanding of C syntax and style.  In
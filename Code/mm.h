@@ -2,11 +2,203 @@
  *
  * The public interface to the students' memory allocator.
  */
+#ifndef __MM_H_
+#define __MM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A variant of the allocator is mm.c compiled with -DMM_VARIANT=<name> and
+ * its own policy macros.  Its functions are prefixed with <name>_ so that
+ * several variants can be linked into one program (see mdriver -m).
+ */
+#ifdef MM_VARIANT
+#define MM_VARIANT_NAME_(variant, name) variant##_##name
+#define MM_VARIANT_NAME(variant, name) MM_VARIANT_NAME_(variant, name)
+#define team MM_VARIANT_NAME(MM_VARIANT, team)
+#define mm_init MM_VARIANT_NAME(MM_VARIANT, mm_init)
+#define mm_malloc MM_VARIANT_NAME(MM_VARIANT, mm_malloc)
+#define mm_free MM_VARIANT_NAME(MM_VARIANT, mm_free)
+#define mm_free_sized MM_VARIANT_NAME(MM_VARIANT, mm_free_sized)
+#define mm_free_mark MM_VARIANT_NAME(MM_VARIANT, mm_free_mark)
+#define mm_realloc MM_VARIANT_NAME(MM_VARIANT, mm_realloc)
+#define mm_memalign MM_VARIANT_NAME(MM_VARIANT, mm_memalign)
+#define mm_usable_size MM_VARIANT_NAME(MM_VARIANT, mm_usable_size)
+#define mm_malloc_batch MM_VARIANT_NAME(MM_VARIANT, mm_malloc_batch)
+#define mm_free_batch MM_VARIANT_NAME(MM_VARIANT, mm_free_batch)
+#define mm_heap_create MM_VARIANT_NAME(MM_VARIANT, mm_heap_create)
+#define mm_heap_malloc MM_VARIANT_NAME(MM_VARIANT, mm_heap_malloc)
+#define mm_heap_memalign MM_VARIANT_NAME(MM_VARIANT, mm_heap_memalign)
+#define mm_heap_free MM_VARIANT_NAME(MM_VARIANT, mm_heap_free)
+#define mm_heap_reset MM_VARIANT_NAME(MM_VARIANT, mm_heap_reset)
+#define mm_heap_destroy MM_VARIANT_NAME(MM_VARIANT, mm_heap_destroy)
+#define mm_region_create MM_VARIANT_NAME(MM_VARIANT, mm_region_create)
+#define mm_region_malloc MM_VARIANT_NAME(MM_VARIANT, mm_region_malloc)
+#define mm_region_mark MM_VARIANT_NAME(MM_VARIANT, mm_region_mark)
+#define mm_region_release MM_VARIANT_NAME(MM_VARIANT, mm_region_release)
+#define mm_region_destroy MM_VARIANT_NAME(MM_VARIANT, mm_region_destroy)
+#define mm_cache_create MM_VARIANT_NAME(MM_VARIANT, mm_cache_create)
+#define mm_cache_alloc MM_VARIANT_NAME(MM_VARIANT, mm_cache_alloc)
+#define mm_cache_free MM_VARIANT_NAME(MM_VARIANT, mm_cache_free)
+#define mm_cache_reap MM_VARIANT_NAME(MM_VARIANT, mm_cache_reap)
+#define mm_cache_destroy MM_VARIANT_NAME(MM_VARIANT, mm_cache_destroy)
+#define mm_malloc_lifetime MM_VARIANT_NAME(MM_VARIANT, mm_malloc_lifetime)
+#define mm_malloc_site MM_VARIANT_NAME(MM_VARIANT, mm_malloc_site)
+#define mm_malloc_caller MM_VARIANT_NAME(MM_VARIANT, mm_malloc_caller)
+#define mm_malloc_near MM_VARIANT_NAME(MM_VARIANT, mm_malloc_near)
+#define mm_malloc_flags MM_VARIANT_NAME(MM_VARIANT, mm_malloc_flags)
+#define mm_handle_alloc MM_VARIANT_NAME(MM_VARIANT, mm_handle_alloc)
+#define mm_handle_free MM_VARIANT_NAME(MM_VARIANT, mm_handle_free)
+#define mm_handle_pin MM_VARIANT_NAME(MM_VARIANT, mm_handle_pin)
+#define mm_handle_unpin MM_VARIANT_NAME(MM_VARIANT, mm_handle_unpin)
+#define mm_compact MM_VARIANT_NAME(MM_VARIANT, mm_compact)
+#define mm_trim MM_VARIANT_NAME(MM_VARIANT, mm_trim)
+#define mm_malloc_tagged MM_VARIANT_NAME(MM_VARIANT, mm_malloc_tagged)
+#define mm_tag_live MM_VARIANT_NAME(MM_VARIANT, mm_tag_live)
+#define mm_tag_set_limits MM_VARIANT_NAME(MM_VARIANT, mm_tag_set_limits)
+#define mm_tag_set_callback MM_VARIANT_NAME(MM_VARIANT, mm_tag_set_callback)
+#define mm_stats MM_VARIANT_NAME(MM_VARIANT, mm_stats)
+#define mm_prof_set_interval MM_VARIANT_NAME(MM_VARIANT, mm_prof_set_interval)
+#define mm_prof_dump MM_VARIANT_NAME(MM_VARIANT, mm_prof_dump)
+#define mm_trace_dump MM_VARIANT_NAME(MM_VARIANT, mm_trace_dump)
+#define mm_dump_heap MM_VARIANT_NAME(MM_VARIANT, mm_dump_heap)
+#define mm_check_slice MM_VARIANT_NAME(MM_VARIANT, mm_check_slice)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 int mm_init(void);
 void *mm_malloc(size_t size);
 void mm_free(void *ptr);
+void mm_free_sized(void *ptr, size_t size);
 void *mm_realloc(void *ptr, size_t size);
+void *mm_memalign(size_t alignment, size_t size);
+size_t mm_usable_size(void *ptr);
+size_t mm_malloc_batch(size_t size, size_t n, void **out);
+void mm_free_batch(void **ptrs, size_t n);
+
+/* Mark a block freed ahead of its mm_free or mm_free_batch, without the
+ * allocator's lock; returns -1 if it was marked before */
+int mm_free_mark(void *ptr);
+
+/* Independent heaps which can drop all their blocks at once */
+typedef struct mm_heap mm_heap_t;
+
+mm_heap_t *mm_heap_create(size_t max_size);
+void *mm_heap_malloc(mm_heap_t *h, size_t size);
+void *mm_heap_memalign(mm_heap_t *h, size_t alignment, size_t size);
+void mm_heap_free(mm_heap_t *h, void *ptr);
+void mm_heap_reset(mm_heap_t *h);
+void mm_heap_destroy(mm_heap_t *h);
+
+/* Bump pointer regions with mark/release, inside the default heap */
+typedef struct mm_region mm_region_t;
+typedef struct {
+    void *chunk;    /* chunk being bumped when the mark was taken */
+    char *top;      /* top of that chunk */
+} mm_region_mark_t;
+
+mm_region_t *mm_region_create(size_t chunk_size);
+void *mm_region_malloc(mm_region_t *r, size_t size);
+mm_region_mark_t mm_region_mark(mm_region_t *r);
+void mm_region_release(mm_region_t *r, mm_region_mark_t mark);
+void mm_region_destroy(mm_region_t *r);
+
+/* Caches of constructed fixed size objects, kept in slabs in the default heap */
+typedef struct mm_cache mm_cache_t;
+
+mm_cache_t *mm_cache_create(size_t size, size_t align,
+                            void (*ctor)(void *), void (*dtor)(void *));
+void *mm_cache_alloc(mm_cache_t *c);
+void mm_cache_free(mm_cache_t *c, void *obj);
+size_t mm_cache_reap(void);
+void mm_cache_destroy(mm_cache_t *c);
+
+/* Allocation with a lifetime hint, given or learned per call site; short
+ * lived blocks are kept apart from long lived ones.  Free with mm_free. */
+#define MM_LIFETIME_LONG  0
+#define MM_LIFETIME_SHORT 1
+
+void *mm_malloc_lifetime(size_t size, int lifetime);
+void *mm_malloc_site(size_t size, uintptr_t site);
+void *mm_malloc_caller(size_t size);
+
+/* Allocation close to an existing block, for structures traversed together */
+void *mm_malloc_near(void *hint, size_t size);
+
+/* Cache placement flags: MM_ISOLATE gives a block cache lines of its own
+ * (no false sharing), MM_COLOR staggers large blocks across cache sets */
+#define MM_ISOLATE 0x1
+#define MM_COLOR   0x2
+
+void *mm_malloc_flags(size_t size, int flags);
+
+/* Movable blocks reached through handles, and the compactor which moves
+ * the unpinned ones to close the holes between blocks */
+typedef struct mm_handle *mm_handle_t;
+
+mm_handle_t mm_handle_alloc(size_t size);
+void mm_handle_free(mm_handle_t h);
+void *mm_handle_pin(mm_handle_t h);
+void mm_handle_unpin(mm_handle_t h);
+size_t mm_compact(size_t budget);
+
+/* Give the free space at the top of the default heap back, keeping "pad" bytes */
+size_t mm_trim(size_t pad);
+
+/* Allocation tagged with the subsystem that owns it.  The live bytes of each
+ * tag are counted; past its soft limit the callback is told, past its hard
+ * limit the callback is told and the allocation fails.  Free with mm_free. */
+#define MM_TAGS 256
+#define MM_LIMIT_SOFT 0
+#define MM_LIMIT_HARD 1
+
+typedef void (*mm_tag_limit_fn)(unsigned int tag, int limit, size_t live);
+
+void *mm_malloc_tagged(size_t size, unsigned int tag);
+size_t mm_tag_live(unsigned int tag);
+void mm_tag_set_limits(unsigned int tag, size_t soft, size_t hard);
+void mm_tag_set_callback(mm_tag_limit_fn fn);
+
+/* Counters of the default heap, cheap enough to read every second */
+#define MM_STATS_CLASSES 10
+
+struct mm_stats {
+    size_t heap_size;           /* bytes taken from memlib */
+    size_t live_bytes;          /* bytes of allocated blocks, headers included */
+    size_t free_bytes;          /* bytes of free blocks */
+    size_t free_blocks;
+    size_t largest_free;        /* size of the largest free block */
+    size_t class_free_bytes[MM_STATS_CLASSES];  /* per segregated class */
+    size_t class_free_blocks[MM_STATS_CLASSES];
+    unsigned long splits;       /* free blocks split by an allocation */
+    unsigned long coalesces;    /* free blocks merged with a neighbour */
+    unsigned long extends;      /* times the heap was grown */
+};
+
+int mm_stats(struct mm_stats *st);
+
+/* Snapshot of the blocks of the default heap for mmfrag, see mm_snapshot.h */
+int mm_dump_heap(int fd);
+
+/* Incremental consistency check of the next "budget" blocks of the default
+ * heap, returns the number of errors found.  A slice stops at the end of a
+ * pass, or where a bad block makes it start again, so with a budget of
+ * SIZE_MAX it finishes the pass under way. */
+int mm_check_slice(size_t budget);
+
+/* Sampled heap profile: an allocation every "interval" bytes on average
+ * keeps its call stack until it is freed, mm_prof_dump writes the live
+ * samples as folded stacks */
+void mm_prof_set_interval(size_t interval);
+int mm_prof_dump(int fd);
+
+/* Recent hot path events of every thread, recorded when mm.c is built with
+ * MM_TRACE=1, one line per event */
+int mm_trace_dump(int fd);
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, personal
@@ -21,3 +213,9 @@ typedef struct {
 } team_t;
 
 extern team_t team;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MM_H_ */
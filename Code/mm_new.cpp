@@ -0,0 +1,158 @@
+/*
+ * mm_new.cpp - replacement global operator new and delete on the mm heap
+ *
+ * Linking mm_new.o, mm.o and memlib.o into a C++ program sends every
+ * new/delete expression of the program to mm_malloc/mm_free, including
+ * the sized and std::align_val_t overloads.  The simulated heap is set up
+ * by the first allocation.  Like the rest of the allocator this is not
+ * thread safe.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "memlib.h"
+#include "mm.h"
+
+/* Set up memlib and the default heap before the first allocation */
+static bool heap_ready = false;
+
+static void *new_block(std::size_t size, std::size_t alignment)
+{
+    void *p;
+
+    if (!heap_ready) {
+	mem_init();
+	if (mm_init() < 0)
+	    throw std::bad_alloc();
+	heap_ready = true;
+    }
+    if (size == 0)
+	size = 1;   /* new must return a unique pointer for empty requests */
+
+    /* Call the new handler until the allocation succeeds, as the standard asks */
+    while ((p = mm_memalign(alignment, size)) == NULL) {
+	std::new_handler handler = std::get_new_handler();
+	if (handler == NULL)
+	    throw std::bad_alloc();
+	handler();
+    }
+    return p;
+}
+
+static void *new_block_nothrow(std::size_t size, std::size_t alignment) noexcept
+{
+    try {
+	return new_block(size, alignment);
+    } catch (...) {
+	return NULL;
+    }
+}
+
+/*
+ * Plain new and delete
+ */
+void *operator new(std::size_t size)
+{
+    return new_block(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new[](std::size_t size)
+{
+    return new_block(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return new_block_nothrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return new_block_nothrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size) noexcept
+{
+    mm_free_sized(ptr, size);
+}
+
+void operator delete[](void *ptr, std::size_t size) noexcept
+{
+    mm_free_sized(ptr, size);
+}
+
+/*
+ * Over-aligned new and delete
+ */
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return new_block(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return new_block(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment,
+		   const std::nothrow_t &) noexcept
+{
+    return new_block_nothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment,
+		     const std::nothrow_t &) noexcept
+{
+    return new_block_nothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    mm_free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size, std::align_val_t) noexcept
+{
+    mm_free_sized(ptr, size);
+}
+
+void operator delete[](void *ptr, std::size_t size, std::align_val_t) noexcept
+{
+    mm_free_sized(ptr, size);
+}
@@ -0,0 +1,116 @@
+/*
+ * mm_pmr.h - C++ adapters for the mm allocator
+ *
+ * mm::heap_resource is a std::pmr::memory_resource and mm::allocator<T> a
+ * standard allocator.  Both allocate from the default heap, or from a heap
+ * made by mm_heap_create when one is given, so a container can be put on a
+ * heap of its own:
+ *
+ *     mm::heap_resource res(mm_heap_create(1 << 20));
+ *     std::pmr::vector<int> v(&res);
+ */
+#ifndef __MM_PMR_H_
+#define __MM_PMR_H_
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#include "mm.h"
+
+namespace mm {
+
+/* Allocate "bytes" aligned to "alignment" from "heap" (the default heap if NULL) */
+inline void *allocate(mm_heap_t *heap, std::size_t bytes, std::size_t alignment)
+{
+    void *p;
+
+    if (bytes == 0)
+	bytes = 1;   /* allocators may not return NULL for empty requests */
+    if (heap == nullptr)
+	p = mm_memalign(alignment, bytes);
+    else
+	p = mm_heap_memalign(heap, alignment, bytes);
+    if (p == nullptr)
+	throw std::bad_alloc();
+    return p;
+}
+
+/* Free a block from allocate(), "bytes" is the size it was allocated with */
+inline void deallocate(mm_heap_t *heap, void *p, std::size_t bytes)
+{
+    if (heap == nullptr)
+	mm_free_sized(p, bytes);
+    else
+	mm_heap_free(heap, p);
+}
+
+class heap_resource : public std::pmr::memory_resource {
+public:
+    explicit heap_resource(mm_heap_t *heap = nullptr) noexcept : heap_(heap) {}
+
+    mm_heap_t *heap() const noexcept { return heap_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+	return mm::allocate(heap_, bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t) override
+    {
+	mm::deallocate(heap_, p, bytes);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+	const heap_resource *r = dynamic_cast<const heap_resource *>(&other);
+	return r != nullptr && r->heap_ == heap_;
+    }
+
+    mm_heap_t *heap_;
+};
+
+template <class T>
+class allocator {
+public:
+    typedef T value_type;
+
+    allocator() noexcept : heap_(nullptr) {}
+    explicit allocator(mm_heap_t *heap) noexcept : heap_(heap) {}
+    template <class U>
+    allocator(const allocator<U> &other) noexcept : heap_(other.heap()) {}
+
+    T *allocate(std::size_t n)
+    {
+	if (n > static_cast<std::size_t>(-1) / sizeof(T))
+	    throw std::bad_array_new_length();
+	return static_cast<T *>(mm::allocate(heap_, n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+	mm::deallocate(heap_, p, n * sizeof(T));
+    }
+
+    mm_heap_t *heap() const noexcept { return heap_; }
+
+private:
+    mm_heap_t *heap_;
+};
+
+template <class T, class U>
+bool operator==(const allocator<T> &a, const allocator<U> &b) noexcept
+{
+    return a.heap() == b.heap();
+}
+
+template <class T, class U>
+bool operator!=(const allocator<T> &a, const allocator<U> &b) noexcept
+{
+    return a.heap() != b.heap();
+}
+
+} /* namespace mm */
+
+#endif /* __MM_PMR_H_ */
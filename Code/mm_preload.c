@@ -0,0 +1,551 @@
+/*
+ * mm_preload.c - the libc allocation functions on top of mm.c
+ *
+ * Built into libmm.so (make -f Makefile.txt libmm.so) together with mm.c
+ * and a memlib.c that maps its heap from the kernel, so that a program
+ * can be run on this allocator with
+ *
+ *     LD_PRELOAD=./libmm.so program
+ *
+ * One mutex serialises the allocator.  It is taken around fork() so the
+ * child never inherits a heap in the middle of an update.
+ *
+ * Built with BACKGROUND_FREE (make -f Makefile.txt libmm_bg.so) free() does
+ * not take the mutex: it marks the block freed with mm_free_mark, which
+ * catches a second free of it, pushes it on a lock free list of pending
+ * frees and returns.  A maintenance thread sleeps while nothing is pending.
+ * Woken by a free, it lets frees gather for DRAIN_INTERVAL_US microseconds,
+ * or until DRAIN_WAKEUP are pending, then takes the list and frees the
+ * blocks (coalescing them and putting them back in the segregated lists)
+ * DRAIN_BATCH at a time, letting go of the mutex between batches.  It
+ * then gives the free space at the top of the heap beyond TRIM_PAD bytes
+ * back to the kernel.  This build is experimental: it has only been
+ * measured on a single processor, where the thread runs in place of the
+ * program, and there mmfreebench finds the requesting thread spends 10-24%
+ * less CPU time but the process up to 17% more, so it is not the default.
+ *
+ * If MM_STATS_SHM is set in the environment the counters of mm_stats are
+ * published in a shared memory segment for mmtop (see mm_shm.h).  They are
+ * copied there with the mutex held, every SHM_PUBLISH_PERIOD calls, so the
+ * allocation path makes no system call for them.
+ *
+ * MM_PROF_INTERVAL=<bytes> in the environment starts the heap profile of
+ * mm.c with that sampling interval, and the live samples are written as
+ * folded stacks to the file named by MM_PROF_FILE when the program exits.
+ * In the same way the event trace of mm.c is written to MM_TRACE_FILE;
+ * only libmm_trace.so, built with MM_TRACE=1, has one.  A snapshot of the
+ * heap for mmfrag is written to MM_HEAP_FILE at exit.
+ *
+ * MM_CHECK_PERIOD=<n> runs the incremental checker of mm.c on CHECK_BUDGET
+ * blocks every n calls, and the program is aborted, for a core dump, as
+ * soon as it finds the heap inconsistent.
+ */
+#define _GNU_SOURCE			/* RTLD_NEXT */
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "mm_shm.h"
+
+#define SHM_PUBLISH_PERIOD 4096
+#define CHECK_BUDGET 32
+
+#ifndef BACKGROUND_FREE
+#define BACKGROUND_FREE 0
+#endif
+
+#if BACKGROUND_FREE
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define DRAIN_BATCH 64			/* blocks freed per hold of the mutex */
+#define DRAIN_WAKEUP 4096		/* pending blocks that wake the thread early */
+#define DRAIN_INTERVAL_US 1000
+#define TRIM_PAD (1 << 20)
+
+enum { DRAINER_NONE, DRAINER_STARTING, DRAINER_RUNNING, DRAINER_FAILED };
+
+static void *_Atomic pending = NULL;	/* freed blocks, linked through their first word */
+static atomic_size_t npending = 0;
+static void *draining = NULL;		/* taken off "pending", under mm_lock */
+static atomic_int drainer_state = DRAINER_NONE;
+static sem_t wakeup;
+#endif
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static int heap_ready = 0;
+
+/* The statistics segment, under mm_lock */
+enum { SEGMENT_UNCHECKED, SEGMENT_OFF, SEGMENT_ON };
+
+static int segment_state = SEGMENT_UNCHECKED;
+static struct mm_shm_stats *segment;
+static char segment_name[MM_SHM_NAME_SIZE];
+static uint64_t calls;
+static uint64_t check_period;		/* 0 without MM_CHECK_PERIOD */
+
+/*
+ * Helper routines.  lock() also sets up the heap on the first call.
+ */
+static void lock(void)
+{
+    const char *interval, *period;
+
+    pthread_mutex_lock(&mm_lock);
+    if (!heap_ready) {
+	mem_init();
+	if (mm_init() < 0)
+	    abort();
+	if ((interval = getenv("MM_PROF_INTERVAL")) != NULL)
+	    mm_prof_set_interval(strtoul(interval, NULL, 0));
+	if ((period = getenv("MM_CHECK_PERIOD")) != NULL)
+	    check_period = strtoull(period, NULL, 0);
+	heap_ready = 1;
+    }
+}
+
+/* Create the statistics segment if the environment asks for one */
+static void open_segment(void)
+{
+    int fd;
+
+    segment_state = SEGMENT_OFF;
+    if (getenv("MM_STATS_SHM") == NULL)
+	return;
+    snprintf(segment_name, sizeof(segment_name), MM_SHM_NAME_FORMAT, (long)getpid());
+    fd = shm_open(segment_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+	return;
+    if (ftruncate(fd, sizeof(struct mm_shm_stats)) == 0) {
+	segment = mmap(NULL, sizeof(struct mm_shm_stats), PROT_READ | PROT_WRITE,
+		       MAP_SHARED, fd, 0);
+	if (segment == MAP_FAILED)
+	    segment = NULL;
+    }
+    close(fd);
+    if (segment == NULL) {
+	shm_unlink(segment_name);
+	return;
+    }
+    segment->magic = MM_SHM_MAGIC;
+    segment->version = MM_SHM_VERSION;
+    segment_state = SEGMENT_ON;
+}
+
+/* Copy the counters into the segment, bracketed by the two seqlock increments */
+static void publish(void)
+{
+    if (segment_state == SEGMENT_UNCHECKED)
+	open_segment();
+    if (segment_state != SEGMENT_ON)
+	return;
+    __atomic_store_n(&segment->seq, segment->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    segment->calls = calls;
+    mm_stats(&segment->stats);
+    __atomic_store_n(&segment->seq, segment->seq + 1, __ATOMIC_RELEASE);
+}
+
+__attribute__((destructor))
+static void remove_segment(void)
+{
+    if (segment_state == SEGMENT_ON)
+	shm_unlink(segment_name);
+}
+
+__attribute__((destructor))
+static void write_profile(void)
+{
+    const char *path = getenv("MM_PROF_FILE");
+    int fd;
+
+    if (path == NULL || !heap_ready)
+	return;
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	return;
+    pthread_mutex_lock(&mm_lock);
+    mm_prof_dump(fd);
+    pthread_mutex_unlock(&mm_lock);
+    close(fd);
+}
+
+__attribute__((destructor))
+static void write_trace(void)
+{
+    const char *path = getenv("MM_TRACE_FILE");
+    int fd;
+
+    if (path == NULL || !heap_ready)
+	return;
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	return;
+    /* The rings are read without the mutex, threads still running go on */
+    mm_trace_dump(fd);
+    close(fd);
+}
+
+__attribute__((destructor))
+static void write_snapshot(void)
+{
+    const char *path = getenv("MM_HEAP_FILE");
+    int fd;
+
+    if (path == NULL || !heap_ready)
+	return;
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	return;
+    pthread_mutex_lock(&mm_lock);
+    mm_dump_heap(fd);
+    pthread_mutex_unlock(&mm_lock);
+    close(fd);
+}
+
+static void unlock(void)
+{
+    if (heap_ready && ++calls % SHM_PUBLISH_PERIOD == 0)
+	publish();
+    if (check_period != 0 && calls % check_period == 0
+	&& mm_check_slice(CHECK_BUDGET) > 0)
+	abort();
+    pthread_mutex_unlock(&mm_lock);
+}
+
+/* Returns true if ptr was handed out by this allocator */
+static int in_heap(void *ptr)
+{
+    return heap_ready && (char *)ptr >= (char *)mem_heap_lo() &&
+	(char *)ptr <= (char *)mem_heap_hi();
+}
+
+#if BACKGROUND_FREE
+/*
+ * Free the pending blocks.  The blocks taken off the list are kept in
+ * "draining" so that a fork between two batches hands them to the child.
+ * Returns the number of blocks freed.
+ */
+static size_t drain(void)
+{
+    size_t n = 0, i;
+    void *next;
+
+    lock();
+    if (draining == NULL)
+	draining = atomic_exchange_explicit(&pending, NULL, memory_order_acquire);
+    for (;;) {
+	for (i = 0; i < DRAIN_BATCH && draining != NULL; i++) {
+	    next = *(void **)draining;
+	    mm_free(draining);
+	    draining = next;
+	}
+	n += i;
+	if (draining == NULL)
+	    break;
+	unlock();			/* let the other threads in between batches */
+	lock();
+    }
+    unlock();
+    atomic_fetch_sub_explicit(&npending, n, memory_order_relaxed);
+    return n;
+}
+
+static void *drainer(void *arg)
+{
+    struct timespec deadline;
+
+    (void)arg;
+    for (;;) {
+	/* Nothing to do until a free, which posts when it finds no block pending */
+	while (atomic_load_explicit(&npending, memory_order_relaxed) == 0)
+	    sem_wait(&wakeup);
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += DRAIN_INTERVAL_US * 1000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+	    deadline.tv_sec++;
+	    deadline.tv_nsec -= 1000000000L;
+	}
+	sem_timedwait(&wakeup, &deadline);	/* let more frees gather */
+	if (drain() > 0) {
+	    lock();
+	    mm_trim(TRIM_PAD);
+	    unlock();
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Start the maintenance thread on the first free.  Not done by lock(), as
+ * pthread_create may allocate.  Returns false if there is no thread to
+ * hand frees to.
+ */
+static int start_drainer(void)
+{
+    int state = DRAINER_NONE;
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    if (atomic_compare_exchange_strong(&drainer_state, &state, DRAINER_STARTING)) {
+	state = DRAINER_FAILED;
+	if (sem_init(&wakeup, 0, 0) == 0 && pthread_attr_init(&attr) == 0) {
+	    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	    if (pthread_create(&thread, &attr, drainer, NULL) == 0)
+		state = DRAINER_RUNNING;
+	    pthread_attr_destroy(&attr);
+	}
+	atomic_store(&drainer_state, state);
+    }
+    return state != DRAINER_FAILED;
+}
+
+/* Mark a block freed and put it on the pending list, without taking the mutex */
+static void defer_free(void *ptr)
+{
+    static const char double_free[] = "libmm: free(): double free detected\n";
+    void *head;
+    size_t before;
+
+    /* Pushed twice the block would make a cycle of the list */
+    if (mm_free_mark(ptr) < 0) {
+	write(STDERR_FILENO, double_free, sizeof(double_free) - 1);
+	abort();
+    }
+    head = atomic_load_explicit(&pending, memory_order_relaxed);
+    do {
+	*(void **)ptr = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pending, &head, ptr,
+						    memory_order_release,
+						    memory_order_relaxed));
+    before = atomic_fetch_add_explicit(&npending, 1, memory_order_relaxed);
+    if (before == 0 || before + 1 == DRAIN_WAKEUP)
+	sem_post(&wakeup);
+}
+#endif
+
+/*
+ * mm_malloc and mm_memalign under the mutex.  With BACKGROUND_FREE a
+ * request which fails while frees are pending is tried again after
+ * freeing them.
+ */
+static void *locked_malloc(size_t size)
+{
+    void *p;
+
+    lock();
+    p = mm_malloc(size);
+    unlock();
+#if BACKGROUND_FREE
+    if (p == NULL && drain() > 0) {
+	lock();
+	p = mm_malloc(size);
+	unlock();
+    }
+#endif
+    return p;
+}
+
+static void *locked_memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    lock();
+    p = mm_memalign(alignment, size);
+    unlock();
+#if BACKGROUND_FREE
+    if (p == NULL && drain() > 0) {
+	lock();
+	p = mm_memalign(alignment, size);
+	unlock();
+    }
+#endif
+    return p;
+}
+
+static void prepare_fork(void)
+{
+    lock();
+}
+
+static void finish_fork(void)
+{
+    unlock();
+}
+
+static void finish_fork_child(void)
+{
+    /* The segment belongs to the parent, the child makes its own */
+    if (segment_state == SEGMENT_ON)
+	munmap(segment, sizeof(struct mm_shm_stats));
+    segment = NULL;
+    segment_state = SEGMENT_UNCHECKED;
+#if BACKGROUND_FREE
+    /* The maintenance thread is not copied, the next free starts another */
+    atomic_store(&drainer_state, DRAINER_NONE);
+#endif
+    unlock();
+}
+
+__attribute__((constructor))
+static void register_fork_handlers(void)
+{
+    pthread_atfork(prepare_fork, finish_fork, finish_fork_child);
+}
+
+/*
+ * Reallocate a block of the libc allocator, from before the library was
+ * loaded: it is copied to a new block of ours and left where it is, as
+ * free() leaves such blocks.  The bytes copied are bounded by the usable
+ * size libc reports for the block, when its malloc_usable_size is found.
+ */
+static void *realloc_foreign(void *ptr, size_t size)
+{
+    static size_t (*libc_usable_size)(void *);
+    size_t copy = size;
+    void *p;
+
+    if (size == 0)
+	return NULL;
+    if ((p = locked_malloc(size)) == NULL) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (libc_usable_size == NULL)
+	libc_usable_size = (size_t (*)(void *))dlsym(RTLD_NEXT, "malloc_usable_size");
+    if (libc_usable_size != NULL && libc_usable_size(ptr) < copy)
+	copy = libc_usable_size(ptr);
+    memcpy(p, ptr, copy);
+    return p;
+}
+
+/*
+ * The interposed functions
+ */
+void *malloc(size_t size)
+{
+    void *p;
+
+    p = locked_malloc(size ? size : 1);  /* malloc(0) returns a unique pointer */
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    /* Blocks from before the library was loaded are not ours to free */
+    if (ptr == NULL || !in_heap(ptr))
+	return;
+#if BACKGROUND_FREE
+    if (start_drainer()) {
+	defer_free(ptr);
+	return;
+    }
+#endif
+    lock();
+    mm_free(ptr);
+    unlock();
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr != NULL && !in_heap(ptr))
+	return realloc_foreign(ptr, size);
+    lock();
+    p = mm_realloc(ptr, size);
+    unlock();
+#if BACKGROUND_FREE
+    if (p == NULL && size != 0 && drain() > 0) {
+	lock();
+	p = mm_realloc(ptr, size);
+	unlock();
+    }
+#endif
+    if (p == NULL && size != 0)
+	errno = ENOMEM;
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t total = nmemb * size;
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    /* Not malloc() + memset(), gcc would turn that back into a call to calloc */
+    p = locked_malloc(total ? total : 1);
+    if (p == NULL)
+	errno = ENOMEM;
+    else
+	memset(p, 0, total);
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    p = locked_memalign(alignment, size ? size : 1);
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+	return EINVAL;
+    p = locked_memalign(alignment, size ? size : 1);
+    if (p == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+
+    return memalign(pagesize, (size + pagesize - 1) & ~(pagesize - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    size_t size;
+
+    if (ptr == NULL || !in_heap(ptr))
+	return 0;
+    lock();
+    size = mm_usable_size(ptr);
+    unlock();
+    return size;
+}
@@ -0,0 +1,31 @@
+/*
+ * mm_shm.h - layout of the shared memory statistics segment
+ *
+ * A program running on libmm.so with MM_STATS_SHM set in its environment
+ * copies the counters of mm_stats into the POSIX shared memory object
+ * "/mm-stats.<pid>" every SHM_PUBLISH_PERIOD allocator calls, and mmtop
+ * reads them from there.  The allocator is the only writer and updates
+ * the segment as a seqlock: "seq" is odd while it writes, so a reader
+ * copies the segment and tries again if "seq" was odd or has changed.
+ */
+#ifndef __MM_SHM_H_
+#define __MM_SHM_H_
+
+#include <stdint.h>
+
+#include "mm.h"
+
+#define MM_SHM_MAGIC 0x6d6d7374u	/* "mmst" */
+#define MM_SHM_VERSION 1
+#define MM_SHM_NAME_FORMAT "/mm-stats.%ld"
+#define MM_SHM_NAME_SIZE 32
+
+struct mm_shm_stats {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;		/* odd while the allocator writes */
+    uint64_t calls;		/* allocator calls when the counters were copied */
+    struct mm_stats stats;
+};
+
+#endif /* __MM_SHM_H_ */
@@ -0,0 +1,44 @@
+/*
+ * mm_snapshot.h - layout of the heap snapshot written by mm_dump_heap
+ *
+ * A snapshot is a header followed by one record per block of the default
+ * heap, in address order from the first block after the prologue to the
+ * last one before the epilogue.  Numbers are in the byte order of the
+ * machine which wrote them; mmfrag reads snapshots of its own machine.
+ */
+#ifndef __MM_SNAPSHOT_H_
+#define __MM_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include "mm.h"
+
+#define MM_SNAPSHOT_MAGIC 0x6d6d6870u	/* "mmhp" */
+#define MM_SNAPSHOT_VERSION 1
+
+/* Flags of a block record, the low bits of its header */
+#define MM_SNAPSHOT_ALLOC 0x1
+#define MM_SNAPSHOT_SAMPLED 0x2		/* a lifetime or heap profile sample */
+#define MM_SNAPSHOT_MOVABLE 0x4		/* an mm_handle_alloc block */
+#define MM_SNAPSHOT_FREED 0x8		/* given to mm_free_mark, not freed yet */
+
+struct mm_snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t heap_lo;		/* address of the first byte of the heap */
+    uint64_t heap_size;		/* bytes from heap_lo to the end of the epilogue */
+    uint64_t page_size;
+    uint64_t word_size;		/* size of a block header, the block starts this far before its address */
+    uint64_t blocks;		/* block records following the header */
+};
+
+struct mm_snapshot_block {
+    uint64_t addr;		/* address of the payload, as returned by mm_malloc */
+    uint64_t size;		/* block size, header and footer included */
+    uint8_t flags;
+    uint8_t class;		/* segregated class the size belongs to */
+    uint8_t tag;		/* tag of mm_malloc_tagged, 0 for none */
+    uint8_t reserved[5];
+};
+
+#endif /* __MM_SNAPSHOT_H_ */
@@ -0,0 +1,522 @@
+/*
+ * mmbench.c - the measurements quoted in writeup.txt
+ *
+ * Each benchmark compares one interface of mm.c beyond malloc and free
+ * with the plain calls it replaces, on a fresh default heap, and prints
+ * the figures the writeup quotes.  "mmbench" runs every benchmark,
+ * "mmbench <name>..." the ones named.  Times are the best of RUNS runs
+ * unless said otherwise.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "mm_snapshot.h"
+
+#define RUNS 5
+
+struct bench {
+    const char *name;
+    void (*run)(void);
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void fresh_heap(void)
+{
+    mem_reset_brk();
+    if (mm_init() < 0) {
+	printf("mm_init failed\n");
+	exit(1);
+    }
+}
+
+static double min_ms(double best, double start)
+{
+    double ms = (now_ns() - start) / 1e6;
+
+    return best < 0 || ms < best ? ms : best;
+}
+
+/*
+ * BATCH_BLOCKS blocks of BATCH_SIZE bytes, one call at a time and by
+ * mm_malloc_batch, then freed one at a time and by mm_free_batch.
+ */
+#define BATCH_BLOCKS 20000
+#define BATCH_SIZE 40
+
+static void bench_batch(void)
+{
+    static void *blocks[BATCH_BLOCKS];
+    double alloc = -1, alloc_batch = -1, teardown = -1, teardown_batch = -1, start;
+    int run, i;
+
+    for (run = 0; run < RUNS; run++) {
+	fresh_heap();
+	start = now_ns();
+	for (i = 0; i < BATCH_BLOCKS; i++)
+	    blocks[i] = mm_malloc(BATCH_SIZE);
+	alloc = min_ms(alloc, start);
+	start = now_ns();
+	for (i = 0; i < BATCH_BLOCKS; i++)
+	    mm_free(blocks[i]);
+	teardown = min_ms(teardown, start);
+
+	fresh_heap();
+	start = now_ns();
+	if (mm_malloc_batch(BATCH_SIZE, BATCH_BLOCKS, blocks) != BATCH_BLOCKS) {
+	    printf("batch: mm_malloc_batch failed\n");
+	    exit(1);
+	}
+	alloc_batch = min_ms(alloc_batch, start);
+	start = now_ns();
+	mm_free_batch(blocks, BATCH_BLOCKS);
+	teardown_batch = min_ms(teardown_batch, start);
+    }
+    printf("batch: %d x %d-byte blocks: allocation %.2f ms -> %.2f ms, "
+	   "teardown %.2f ms -> %.2f ms\n", BATCH_BLOCKS, BATCH_SIZE,
+	   alloc, alloc_batch, teardown, teardown_batch);
+}
+
+/*
+ * REGION_BLOCKS allocations of 24 to 87 bytes with mm_malloc and from a
+ * region.
+ */
+#define REGION_BLOCKS 20000
+
+static void bench_region(void)
+{
+    static void *blocks[REGION_BLOCKS];
+    static size_t sizes[REGION_BLOCKS];
+    double plain = -1, region = -1, start;
+    mm_region_t *r;
+    int run, i;
+
+    srand(1);
+    for (i = 0; i < REGION_BLOCKS; i++)
+	sizes[i] = 24 + rand() % 64;
+    for (run = 0; run < RUNS; run++) {
+	fresh_heap();
+	start = now_ns();
+	for (i = 0; i < REGION_BLOCKS; i++)
+	    blocks[i] = mm_malloc(sizes[i]);
+	plain = min_ms(plain, start);
+
+	fresh_heap();
+	r = mm_region_create(64 * 1024);
+	start = now_ns();
+	for (i = 0; i < REGION_BLOCKS; i++)
+	    blocks[i] = mm_region_malloc(r, sizes[i]);
+	region = min_ms(region, start);
+	if (blocks[REGION_BLOCKS - 1] == NULL) {
+	    printf("region: out of memory\n");
+	    exit(1);
+	}
+	mm_region_destroy(r);
+    }
+    printf("region: %d allocations of 24..87 bytes: mm_malloc %.2f ms, "
+	   "mm_region_malloc %.2f ms\n", REGION_BLOCKS, plain, region);
+}
+
+/*
+ * LIFETIME_REQUESTS requests, each making 200 temporaries of 16 to 415
+ * bytes and keeping 4 blocks of 32 to 127 bytes made among them; every
+ * fourth request frees one kept block once more than 1000 are kept.  Run
+ * with mm_malloc, with a site for the temporaries and one for the kept
+ * blocks, and with explicit lifetime hints.  The short lived heap is
+ * measured by the span of the blocks in it, which is outside the default
+ * heap.
+ */
+#define LIFETIME_REQUESTS 8000
+
+static void *lifetime_alloc(int mode, size_t size, int lifetime)
+{
+    if (mode == 0)
+	return mm_malloc(size);
+    if (mode == 1)
+	return mm_malloc_site(size, lifetime == MM_LIFETIME_SHORT ? 1 : 2);
+    return mm_malloc_lifetime(size, lifetime);
+}
+
+static void bench_lifetime(void)
+{
+    static const char *modes[] = { "mm_malloc", "mm_malloc_site", "mm_malloc_lifetime" };
+    static void *keep[LIFETIME_REQUESTS * 4];
+    char *lo, *hi, *end;
+    size_t live;
+    void *tmp[200];
+    int mode, r, i, k, nkeep;
+
+    for (mode = 0; mode < 3; mode++) {
+	fresh_heap();
+	srand(5);
+	lo = hi = NULL;
+	nkeep = 0;
+	for (r = 0; r < LIFETIME_REQUESTS; r++) {
+	    for (i = 0; i < 200; i++) {
+		tmp[i] = lifetime_alloc(mode, 16 + rand() % 400, MM_LIFETIME_SHORT);
+		if ((void *)tmp[i] < mem_heap_lo() || (void *)tmp[i] > mem_heap_hi()) {
+		    end = (char *)tmp[i] + mm_usable_size(tmp[i]);
+		    lo = lo == NULL || (char *)tmp[i] < lo ? (char *)tmp[i] : lo;
+		    hi = end > hi ? end : hi;
+		}
+		if (i % 50 == 25)
+		    keep[nkeep++] = lifetime_alloc(mode, 32 + rand() % 96, MM_LIFETIME_LONG);
+	    }
+	    for (i = 0; i < 200; i++)
+		mm_free(tmp[i]);
+	    if (r % 4 == 0 && nkeep > 1000) {
+		k = rand() % nkeep;
+		mm_free(keep[k]);
+		keep[k] = keep[--nkeep];
+	    }
+	}
+	for (live = 0, i = 0; i < nkeep; i++)
+	    live += mm_usable_size(keep[i]) + 2 * sizeof(size_t);	/* with header and footer */
+	printf("lifetime: %-18s default heap %zu KB, short lived heap %zu KB, "
+	       "%d kept blocks of %zu KB\n", modes[mode], mem_heapsize() / 1024,
+	       (size_t)(hi - lo) / 1024, nkeep, live / 1024);
+	for (i = 0; i < nkeep; i++)
+	    mm_free(keep[i]);
+    }
+}
+
+/*
+ * A list of NEAR_NODES nodes built in a heap where half of 2 * NEAR_NODES
+ * blocks were freed in random order, with an unrelated allocation after
+ * every fourth node, by mm_malloc and by mm_malloc_near(previous node).
+ * Prints the share of the links which cross 4 KB and the time per node of
+ * a traversal, averaged over NEAR_ROUNDS.
+ */
+#define NEAR_NODES 60000
+#define NEAR_ROUNDS 200
+
+struct node {
+    struct node *next;
+    long value;
+    char pad[32];
+};
+
+static void bench_near(void)
+{
+    static void *junk[2 * NEAR_NODES];
+    struct node *head, *tail, *n;
+    double start, ns;
+    long far, distance, sum = 0;
+    int near, i, k, r;
+    void *tmp;
+
+    for (near = 0; near < 2; near++) {
+	fresh_heap();
+	srand(9);
+	for (i = 0; i < 2 * NEAR_NODES; i++)
+	    junk[i] = mm_malloc(48 + rand() % 64);
+	for (i = 0; i < 2 * NEAR_NODES; i++) {
+	    k = rand() % (2 * NEAR_NODES);
+	    tmp = junk[i];
+	    junk[i] = junk[k];
+	    junk[k] = tmp;
+	}
+	for (i = 0; i < 2 * NEAR_NODES; i += 2)
+	    mm_free(junk[i]);
+
+	head = tail = NULL;
+	for (i = 0; i < NEAR_NODES; i++) {
+	    n = near && tail != NULL ? mm_malloc_near(tail, sizeof(*n)) : mm_malloc(sizeof(*n));
+	    n->next = NULL;
+	    n->value = i;
+	    if (tail != NULL)
+		tail->next = n;
+	    else
+		head = n;
+	    tail = n;
+	    if (i % 4 == 0)
+		mm_malloc(80);
+	}
+	for (far = 0, n = head; n->next != NULL; n = n->next) {
+	    distance = (char *)n->next - (char *)n;
+	    if (distance >= 4096 || distance <= -4096)
+		far++;
+	}
+	start = now_ns();
+	for (r = 0; r < NEAR_ROUNDS; r++)
+	    for (n = head; n != NULL; n = n->next)
+		sum += n->value;
+	ns = (now_ns() - start) / ((double)NEAR_ROUNDS * NEAR_NODES);
+	printf("near: %-14s %.1f%% of %d links cross 4 KB, traversal %.0f ns/node\n",
+	       near ? "mm_malloc_near" : "mm_malloc", 100.0 * far / NEAR_NODES, NEAR_NODES, ns);
+    }
+    if (sum == 0)
+	printf("near: empty lists\n");
+}
+
+/*
+ * COMPACT_HANDLES handles of 16 to 255 bytes of which 70% are freed at
+ * random, then mm_compact(COMPACT_BUDGET) until a whole pass neither
+ * moves a block nor shrinks the heap; then again with every 6000th live
+ * block pinned.  Prints the heap size before and after, the calls which
+ * did something and the longest call.
+ */
+#define COMPACT_HANDLES 60000
+#define COMPACT_BUDGET (64 * 1024)
+
+static size_t heap_size(void)
+{
+    struct mm_stats st;
+
+    mm_stats(&st);
+    return st.heap_size;
+}
+
+static void bench_compact(void)
+{
+    static mm_handle_t handles[COMPACT_HANDLES];
+    static size_t sizes[COMPACT_HANDLES];
+    size_t live, before, size, moved;
+    double start, ms, worst;
+    int pinned, i, calls, idle, npinned;
+
+    for (pinned = 0; pinned < 2; pinned++) {
+	fresh_heap();
+	srand(11);
+	live = 0;
+	for (i = 0; i < COMPACT_HANDLES; i++) {
+	    sizes[i] = 16 + rand() % 240;
+	    handles[i] = mm_handle_alloc(sizes[i]);
+	    memset(mm_handle_pin(handles[i]), i, sizes[i]);
+	    mm_handle_unpin(handles[i]);
+	}
+	for (i = 0; i < COMPACT_HANDLES; i++) {
+	    if (rand() % 10 < 7) {
+		mm_handle_free(handles[i]);
+		handles[i] = NULL;
+	    } else
+		live += sizes[i];
+	}
+	for (i = 0, npinned = 0; pinned && i < COMPACT_HANDLES; i++)
+	    if (handles[i] != NULL && npinned++ % 6000 == 0)
+		mm_handle_pin(handles[i]);
+
+	before = heap_size();
+	calls = idle = 0;
+	worst = 0;
+	while (idle < 2 * COMPACT_HANDLES * 16 / COMPACT_BUDGET + 2) {	/* a pass over every block, twice */
+	    size = heap_size();
+	    start = now_ns();
+	    moved = mm_compact(COMPACT_BUDGET);
+	    ms = (now_ns() - start) / 1e6;
+	    worst = ms > worst ? ms : worst;
+	    if (moved != 0 || heap_size() != size) {
+		calls += idle + 1;
+		idle = 0;
+	    } else
+		idle++;
+	}
+	printf("compact: %s heap %zu KB -> %zu KB for %zu KB of live payload, %d calls, "
+	       "longest %.2f ms\n", pinned ? "every 6000th pinned," : "nothing pinned,",
+	       before / 1024, heap_size() / 1024, live / 1024, calls, worst);
+    }
+}
+
+/*
+ * The heap profile.  PROF_OPS malloc/free pairs of 64 bytes with every
+ * allocation sampled and with none, for the cost of a sample; PROF_OPS
+ * pairs in bands of sizes from 16 to 4111 bytes with no profile and at an
+ * interval of PROF_INTERVAL, for its overhead, which grows with the bytes
+ * allocated per call; then PROF_SMALL blocks of 100 bytes and PROF_LARGE
+ * of 5000 kept at an interval of PROF_SITE_INTERVAL, with the bytes the
+ * profile attributes to each call site.  The pairs are timed in chunks
+ * of PROF_CHUNK, each chunk once with the profile and once without, in
+ * turn, on the CPU time of the thread, and the times of PROF_PASSES passes
+ * are added up: a difference of a fraction of a percent is lost in the
+ * drift of the machine between two whole runs.
+ */
+#define PROF_OPS 200000
+#define PROF_CHUNK 1000
+#define PROF_PASSES 10
+#define PROF_INTERVAL (512 << 10)
+#define PROF_SMALL 40000
+#define PROF_LARGE 200
+#define PROF_SITE_INTERVAL (16 << 10)
+
+/* Call sites of their own, global and not inlined so that the profile names them */
+__attribute__((noinline)) void prof_site_small(void **blocks, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	blocks[i] = mm_malloc(100);
+}
+
+__attribute__((noinline)) void prof_site_large(void **blocks, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	blocks[i] = mm_malloc(5000);
+}
+
+static double cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Times in ns per pair of the malloc/free pairs of "lo" to "hi" bytes without the profile and at "interval" */
+static void prof_loops(size_t lo, size_t hi, size_t interval, double *plain, double *sampled)
+{
+    static size_t sizes[PROF_OPS];
+    double time[2] = { 0, 0 }, start;
+    int pass, chunk, turn, on, i;
+
+    srand(13);
+    for (i = 0; i < PROF_OPS; i++)
+	sizes[i] = lo + rand() % (hi - lo + 1);
+    fresh_heap();
+    for (pass = 0; pass < PROF_PASSES; pass++) {
+	for (chunk = 0; chunk < PROF_OPS / PROF_CHUNK; chunk++) {
+	    for (turn = 0; turn < 2; turn++) {
+		on = (pass + chunk + turn) % 2;	/* either goes first as often */
+		mm_prof_set_interval(on ? interval : 0);
+		start = cpu_ns();
+		for (i = chunk * PROF_CHUNK; i < (chunk + 1) * PROF_CHUNK; i++)
+		    mm_free(mm_malloc(sizes[i]));
+		time[on] += cpu_ns() - start;
+	    }
+	}
+    }
+    mm_prof_set_interval(0);
+    *plain = time[0] / ((double)PROF_PASSES * PROF_OPS);
+    *sampled = time[1] / ((double)PROF_PASSES * PROF_OPS);
+}
+
+static void bench_prof(void)
+{
+    static void *small[PROF_SMALL], *large[PROF_LARGE];
+    static const size_t bands[][2] = { { 16, 64 }, { 64, 512 }, { 512, 2048 }, { 2048, 4111 }, { 16, 4111 } };
+    double plain, sampled;
+    size_t i, small_bytes = 0, large_bytes = 0, weight;
+    char line[4096], *space;
+    FILE *f;
+
+    prof_loops(64, 64, 1, &plain, &sampled);
+    printf("prof: a sample costs %.0f ns\n", sampled - plain);
+    for (i = 0; i < sizeof(bands) / sizeof(bands[0]); i++) {
+	prof_loops(bands[i][0], bands[i][1], PROF_INTERVAL, &plain, &sampled);
+	printf("prof: malloc/free of %zu-%zu bytes %.1f ns without the profile, %.1f ns at an "
+	       "interval of %d KB, %.2f%% overhead\n", bands[i][0], bands[i][1], plain, sampled,
+	       PROF_INTERVAL >> 10, 100 * (sampled - plain) / plain);
+    }
+
+    fresh_heap();
+    mm_prof_set_interval(PROF_SITE_INTERVAL);
+    prof_site_small(small, PROF_SMALL);
+    prof_site_large(large, PROF_LARGE);
+    if ((f = tmpfile()) == NULL || mm_prof_dump(fileno(f)) < 0) {
+	printf("prof: no profile written\n");
+	return;
+    }
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+	if ((space = strrchr(line, ' ')) == NULL)
+	    continue;
+	weight = strtoul(space + 1, NULL, 10);
+	if (strstr(line, "prof_site_small") != NULL)
+	    small_bytes += weight;
+	else if (strstr(line, "prof_site_large") != NULL)
+	    large_bytes += weight;
+    }
+    fclose(f);
+    printf("prof: at an interval of %d KB, %.2f MB attributed to the %d KB in 100 byte blocks, "
+	   "%.2f MB to the %d KB in 5000 byte blocks\n", PROF_SITE_INTERVAL >> 10,
+	   small_bytes / 1048576.0, PROF_SMALL * 100 >> 10, large_bytes / 1048576.0, PROF_LARGE * 5000 >> 10);
+}
+
+/*
+ * The fragmenting program of the writeup.  FRAG_BLOCKS blocks, every 8th
+ * of 3000 bytes and the others of 100, then every 3000 byte block and
+ * every third small one freed.  Prints the heap size, the share of it
+ * which is free, the free blocks, the share of the free bytes outside the
+ * largest free block, as mmfrag does, and the pages wholly free, counted
+ * on a snapshot of mm_dump_heap.
+ */
+#define FRAG_BLOCKS 40000
+
+static void bench_frag(void)
+{
+    static void *blocks[FRAG_BLOCKS];
+    struct mm_snapshot_header hdr;
+    struct mm_snapshot_block b;
+    struct mm_stats st;
+    uint64_t start, first_page, end_page;
+    size_t free_pages = 0;
+    int i, small = 0;
+    FILE *f;
+
+    fresh_heap();
+    for (i = 0; i < FRAG_BLOCKS; i++)
+	blocks[i] = mm_malloc(i % 8 == 0 ? 3000 : 100);
+    for (i = 0; i < FRAG_BLOCKS; i++)
+	if (i % 8 == 0 || small++ % 3 == 0)
+	    mm_free(blocks[i]);
+    mm_stats(&st);
+    printf("frag: heap %.1f MB, %.0f%% free in %zu blocks, largest %zu bytes, "
+	   "%.1f%% external fragmentation\n", st.heap_size / 1048576.0,
+	   100.0 * st.free_bytes / st.heap_size, st.free_blocks, st.largest_free,
+	   100.0 * (st.free_bytes - st.largest_free) / st.free_bytes);
+
+    if ((f = tmpfile()) == NULL || mm_dump_heap(fileno(f)) < 0) {
+	printf("frag: no snapshot written\n");
+	return;
+    }
+    rewind(f);
+    if (fread(&hdr, sizeof(hdr), 1, f) == 1) {
+	while (fread(&b, sizeof(b), 1, f) == 1) {
+	    start = b.addr - hdr.word_size;	/* free blocks are never next to each other */
+	    first_page = (start + hdr.page_size - 1) / hdr.page_size;
+	    end_page = (start + b.size) / hdr.page_size;
+	    if (!(b.flags & MM_SNAPSHOT_ALLOC) && end_page > first_page)
+		free_pages += end_page - first_page;
+	}
+    }
+    fclose(f);
+    printf("frag: %zu pages wholly free of %zu\n", free_pages, (size_t)(hdr.heap_size / hdr.page_size));
+}
+
+static const struct bench benches[] = {
+    { "batch", bench_batch },
+    { "region", bench_region },
+    { "lifetime", bench_lifetime },
+    { "near", bench_near },
+    { "compact", bench_compact },
+    { "prof", bench_prof },
+    { "frag", bench_frag },
+};
+
+int main(int argc, char **argv)
+{
+    size_t i;
+    int j, run;
+
+    mem_init();
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+	run = argc == 1;
+	for (j = 1; j < argc; j++)
+	    run |= strcmp(argv[j], benches[i].name) == 0;
+	if (run)
+	    benches[i].run();
+    }
+    return 0;
+}
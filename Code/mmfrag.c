@@ -0,0 +1,322 @@
+/*
+ * mmfrag.c - analyse the fragmentation of a heap snapshot
+ *
+ *     MM_HEAP_FILE=heap.snap LD_PRELOAD=./libmm.so program
+ *     ./mmfrag heap.snap
+ *
+ * Reads a snapshot written by mm_dump_heap (see mm_snapshot.h) and prints
+ *  - the external fragmentation of the free space, of the whole heap and of
+ *    each segregated class: the share of the free bytes which are not in
+ *    the largest free block, so a request larger than that block extends
+ *    the heap although the free bytes would hold it;
+ *  - the largest holes and the sizes of all of them by power of two;
+ *  - the allocated blocks nearest the top of the heap, which pin the free
+ *    space below them: mm_trim gives back only the free block at the top;
+ *  - how much of each page is in free blocks, as a map of the heap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm_snapshot.h"
+
+#define LARGEST_HOLES 8
+#define PINNING_BLOCKS 8
+#define HOLE_BUCKETS 40		/* powers of two of the hole sizes */
+#define MAP_WIDTH 64		/* cells per line of the page map */
+#define MAP_CELLS (MAP_WIDTH * 32)
+
+/* Shades of the page map, from no byte in use to all of them */
+static const char shades[] = " .:-=+*#%@";
+
+/* Blocks of one class */
+struct class_summary {
+    uint64_t min_size, max_size;
+    uint64_t alloc_blocks, alloc_bytes;
+    uint64_t free_blocks, free_bytes;
+    uint64_t largest_free;
+};
+
+static void print_bytes(uint64_t bytes)
+{
+    if (bytes >= (1 << 20))
+	printf("%8.1f MB", bytes / 1048576.0);
+    else if (bytes >= (1 << 10))
+	printf("%8.1f KB", bytes / 1024.0);
+    else
+	printf("%9llu B", (unsigned long long)bytes);
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static int compare_hole_sizes(const void *a, const void *b)
+{
+    const struct mm_snapshot_block *x = *(const struct mm_snapshot_block *const *)a;
+    const struct mm_snapshot_block *y = *(const struct mm_snapshot_block *const *)b;
+
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+/* Byte offset of the start of a block from the bottom of the heap */
+static uint64_t block_start(const struct mm_snapshot_header *hdr, const struct mm_snapshot_block *b)
+{
+    return b->addr - hdr->word_size - hdr->heap_lo;
+}
+
+static void print_classes(const struct mm_snapshot_block *blocks, uint64_t n)
+{
+    struct class_summary cls[MM_STATS_CLASSES];
+    uint64_t i;
+    int c;
+
+    memset(cls, 0, sizeof(cls));
+    for (i = 0; i < n; i++) {
+	struct class_summary *s = &cls[blocks[i].class < MM_STATS_CLASSES ? blocks[i].class
+				       : MM_STATS_CLASSES - 1];
+
+	if (s->min_size == 0 || blocks[i].size < s->min_size)
+	    s->min_size = blocks[i].size;
+	if (blocks[i].size > s->max_size)
+	    s->max_size = blocks[i].size;
+	if (blocks[i].flags & MM_SNAPSHOT_ALLOC) {
+	    s->alloc_blocks++;
+	    s->alloc_bytes += blocks[i].size;
+	} else {
+	    s->free_blocks++;
+	    s->free_bytes += blocks[i].size;
+	    if (blocks[i].size > s->largest_free)
+		s->largest_free = blocks[i].size;
+	}
+    }
+
+    printf("class  block sizes        allocated             free                 largest free  fragmentation\n");
+    for (c = 0; c < MM_STATS_CLASSES; c++) {
+	const struct class_summary *s = &cls[c];
+
+	if (s->min_size == 0)
+	    continue;
+	printf("%5d  %8llu-%-8llu %8llu ", c, (unsigned long long)s->min_size,
+	       (unsigned long long)s->max_size, (unsigned long long)s->alloc_blocks);
+	print_bytes(s->alloc_bytes);
+	printf("  %8llu ", (unsigned long long)s->free_blocks);
+	print_bytes(s->free_bytes);
+	printf("  ");
+	print_bytes(s->largest_free);
+	printf("  %5.1f%%\n", s->free_bytes ? 100.0 - percent(s->largest_free, s->free_bytes) : 0.0);
+    }
+    printf("\n");
+}
+
+static void print_holes(const struct mm_snapshot_header *hdr, const struct mm_snapshot_block *blocks,
+			uint64_t n)
+{
+    const struct mm_snapshot_block **holes;
+    uint64_t count[HOLE_BUCKETS], bytes[HOLE_BUCKETS];
+    uint64_t i, nholes = 0, free_bytes = 0;
+    int b;
+
+    if ((holes = malloc((n + 1) * sizeof(*holes))) == NULL) {
+	perror("malloc");
+	exit(1);
+    }
+    memset(count, 0, sizeof(count));
+    memset(bytes, 0, sizeof(bytes));
+    for (i = 0; i < n; i++) {
+	if (blocks[i].flags & MM_SNAPSHOT_ALLOC)
+	    continue;
+	holes[nholes++] = &blocks[i];
+	free_bytes += blocks[i].size;
+	for (b = 0; b < HOLE_BUCKETS - 1 && ((uint64_t)2 << b) <= blocks[i].size; b++)
+	    ;
+	count[b]++;
+	bytes[b] += blocks[i].size;
+    }
+    if (nholes == 0) {
+	printf("no free blocks\n\n");
+	free(holes);
+	return;
+    }
+    qsort(holes, nholes, sizeof(*holes), compare_hole_sizes);
+
+    printf("%llu holes, mean ", (unsigned long long)nholes);
+    print_bytes(free_bytes / nholes);
+    printf(", median ");
+    print_bytes(holes[nholes / 2]->size);
+    printf("\nlargest holes      offset       size    share of the free bytes\n");
+    for (i = 0; i < nholes && i < LARGEST_HOLES; i++) {
+	printf("       %18llx ", (unsigned long long)block_start(hdr, holes[i]));
+	print_bytes(holes[i]->size);
+	printf("  %5.1f%%\n", percent(holes[i]->size, free_bytes));
+    }
+    printf("hole sizes (bytes)        holes      total\n");
+    for (b = 0; b < HOLE_BUCKETS; b++) {
+	if (count[b] == 0)
+	    continue;
+	printf("  %10llu-%-10llu ", 1ULL << b, (2ULL << b) - 1);
+	printf("%8llu ", (unsigned long long)count[b]);
+	print_bytes(bytes[b]);
+	printf("\n");
+    }
+    printf("\n");
+    free(holes);
+}
+
+/*
+ * The heap can only shrink down to the end of its highest allocated block,
+ * so print the allocated blocks from the top down with the bytes the heap
+ * could give back if they and the ones above them were freed or moved.
+ */
+static void print_pinning(const struct mm_snapshot_header *hdr, const struct mm_snapshot_block *blocks,
+			  uint64_t n)
+{
+    uint64_t end = hdr->heap_size - hdr->word_size;	/* the epilogue header */
+    uint64_t trimmable = 0, live_above = 0;
+    int64_t i, lo;
+    int shown = 0;
+
+    if (n > 0 && !(blocks[n - 1].flags & MM_SNAPSHOT_ALLOC))
+	trimmable = blocks[n - 1].size;
+    printf("free at the top of the heap, mm_trim gives it back: ");
+    print_bytes(trimmable);
+    printf("\npinning blocks          offset       size  tag  live above  heap could shrink by\n");
+    for (i = (int64_t)n - 1; i >= 0 && shown < PINNING_BLOCKS; i--) {
+	if (!(blocks[i].flags & MM_SNAPSHOT_ALLOC))
+	    continue;
+	live_above += blocks[i].size;
+	/* Without this block and the ones above, the top free block would start where the next one below ends */
+	for (lo = i; lo > 0 && !(blocks[lo - 1].flags & MM_SNAPSHOT_ALLOC); lo--)
+	    ;
+	printf("            %18llx ", (unsigned long long)block_start(hdr, &blocks[i]));
+	printf("%10llu %4u ", (unsigned long long)blocks[i].size, blocks[i].tag);
+	print_bytes(live_above);
+	printf("  ");
+	print_bytes(end - block_start(hdr, &blocks[lo]));
+	printf("\n");
+	shown++;
+    }
+    printf("\n");
+}
+
+/*
+ * Print the share of the bytes of each page which are not in free blocks,
+ * MAP_WIDTH cells to a line.  A large heap is shown with several pages to
+ * a cell.  Pages wholly in free blocks could be given back to the kernel.
+ */
+static void print_page_map(const struct mm_snapshot_header *hdr, const struct mm_snapshot_block *blocks,
+			   uint64_t n)
+{
+    uint64_t page = hdr->page_size ? hdr->page_size : 4096;
+    uint64_t pages = (hdr->heap_size + page - 1) / page;
+    uint64_t per_cell = (pages + MAP_CELLS - 1) / MAP_CELLS;
+    uint64_t *free_bytes, empty = 0, full = 0, i, p, cell;
+    double used;
+
+    if (pages == 0)
+	return;
+    if ((free_bytes = calloc(pages, sizeof(*free_bytes))) == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    for (i = 0; i < n; i++) {
+	uint64_t start = block_start(hdr, &blocks[i]), stop = start + blocks[i].size;
+
+	if (blocks[i].flags & MM_SNAPSHOT_ALLOC)
+	    continue;
+	for (p = start / page; p * page < stop; p++) {
+	    uint64_t lo = p * page > start ? p * page : start;
+	    uint64_t hi = (p + 1) * page < stop ? (p + 1) * page : stop;
+
+	    free_bytes[p] += hi - lo;
+	}
+    }
+    for (p = 0; p < pages; p++) {
+	if (free_bytes[p] >= page)
+	    empty++;
+	else if (free_bytes[p] == 0)
+	    full++;
+    }
+
+    printf("%llu pages of %llu bytes: %llu without free bytes, %llu wholly free (", (unsigned long long)pages,
+	   (unsigned long long)page, (unsigned long long)full, (unsigned long long)empty);
+    print_bytes(empty * page);
+    printf("), %llu partly free\n", (unsigned long long)(pages - empty - full));
+    printf("page map, %llu page%s a cell, ' ' wholly free to '@' no free byte\n",
+	   (unsigned long long)per_cell, per_cell == 1 ? "" : "s");
+    for (cell = 0; cell * per_cell < pages; cell++) {
+	uint64_t freed = 0, bytes = 0;
+
+	if (cell % MAP_WIDTH == 0)
+	    printf("%s%12llx |", cell ? "|\n" : "", (unsigned long long)(cell * per_cell * page));
+	for (p = cell * per_cell; p < (cell + 1) * per_cell && p < pages; p++) {
+	    freed += free_bytes[p];
+	    bytes += page;
+	}
+	used = 1.0 - (double)freed / bytes;
+	putchar(used <= 0.0 ? shades[0] : shades[1 + (int)(used * (sizeof(shades) - 2.001))]);
+    }
+    printf("|\n");
+    free(free_bytes);
+}
+
+int main(int argc, char **argv)
+{
+    struct mm_snapshot_header hdr;
+    struct mm_snapshot_block *blocks;
+    uint64_t i, alloc_bytes = 0, free_bytes = 0, largest_free = 0, nfree = 0;
+    FILE *f;
+
+    if (argc != 2) {
+	fprintf(stderr, "usage: %s <snapshot of mm_dump_heap>\n", argv[0]);
+	exit(1);
+    }
+    if ((f = fopen(argv[1], "rb")) == NULL) {
+	perror(argv[1]);
+	exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != MM_SNAPSHOT_MAGIC ||
+	hdr.version != MM_SNAPSHOT_VERSION) {
+	fprintf(stderr, "%s: %s is not a heap snapshot of this version\n", argv[0], argv[1]);
+	exit(1);
+    }
+    if ((blocks = malloc((hdr.blocks + 1) * sizeof(*blocks))) == NULL) {
+	perror("malloc");
+	exit(1);
+    }
+    if (fread(blocks, sizeof(*blocks), hdr.blocks, f) != hdr.blocks) {
+	fprintf(stderr, "%s: %s is cut short\n", argv[0], argv[1]);
+	exit(1);
+    }
+    fclose(f);
+
+    for (i = 0; i < hdr.blocks; i++) {
+	if (blocks[i].flags & MM_SNAPSHOT_ALLOC) {
+	    alloc_bytes += blocks[i].size;
+	} else {
+	    nfree++;
+	    free_bytes += blocks[i].size;
+	    if (blocks[i].size > largest_free)
+		largest_free = blocks[i].size;
+	}
+    }
+    printf("heap ");
+    print_bytes(hdr.heap_size);
+    printf(" at %#llx, %llu blocks\nallocated ", (unsigned long long)hdr.heap_lo,
+	   (unsigned long long)hdr.blocks);
+    print_bytes(alloc_bytes);
+    printf(" (%4.1f%%)  free ", percent(alloc_bytes, hdr.heap_size));
+    print_bytes(free_bytes);
+    printf(" (%4.1f%%) in %llu blocks  largest free ", percent(free_bytes, hdr.heap_size),
+	   (unsigned long long)nfree);
+    print_bytes(largest_free);
+    printf("\nexternal fragmentation %.1f%%\n\n", free_bytes ? 100.0 - percent(largest_free, free_bytes) : 0.0);
+
+    print_classes(blocks, hdr.blocks);
+    print_holes(&hdr, blocks, hdr.blocks);
+    print_pinning(&hdr, blocks, hdr.blocks);
+    print_page_map(&hdr, blocks, hdr.blocks);
+    free(blocks);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * mmfreebench.c - cost of free() under libmm.so and libmm_bg.so
+ *
+ * An ordinary malloc/free program, to be run under either library:
+ *
+ *     LD_PRELOAD=./libmm.so ./mmfreebench
+ *     LD_PRELOAD=./libmm_bg.so ./mmfreebench
+ *
+ * Each round allocates BLOCKS blocks of 16 to 1040 bytes, writes them and
+ * frees them in a shuffled order.  The median time of a free() call and
+ * the total time of the rounds are printed, and the CPU time of the rounds
+ * spent in this thread and in the others of the process, which shows how
+ * much work a maintenance thread takes off the thread making the requests
+ * whatever the number of processors.  Then the program sleeps for
+ * IDLE_MS with nothing to free and prints how many times the threads of
+ * the process were switched out meanwhile, to show whether a maintenance
+ * thread wakes up when it has nothing to do.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCKS 50000
+#define ROUNDS 20
+#define IDLE_MS 500
+
+static double clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double now_ns(void)
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Voluntary context switches of all the threads of the process */
+static long context_switches(void)
+{
+    char path[300], line[128];
+    struct dirent *d;
+    long total = 0, n;
+    DIR *tasks;
+    FILE *f;
+
+    if ((tasks = opendir("/proc/self/task")) == NULL)
+	return -1;
+    while ((d = readdir(tasks)) != NULL) {
+	if (d->d_name[0] == '.')
+	    continue;
+	snprintf(path, sizeof(path), "/proc/self/task/%s/status", d->d_name);
+	if ((f = fopen(path, "r")) == NULL)
+	    continue;
+	while (fgets(line, sizeof(line), f) != NULL)
+	    if (sscanf(line, "voluntary_ctxt_switches: %ld", &n) == 1)
+		total += n;
+	fclose(f);
+    }
+    closedir(tasks);
+    return total;
+}
+
+int main(void)
+{
+    static void *blocks[BLOCKS];
+    static double frees[BLOCKS * ROUNDS];
+    struct timespec idle = { IDLE_MS / 1000, IDLE_MS % 1000 * 1000000L };
+    size_t i, j, nfrees = 0;
+    double start, t, thread_cpu, process_cpu;
+    long before;
+    void *tmp;
+
+    srand(1);
+    thread_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    process_cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    start = now_ns();
+    for (int round = 0; round < ROUNDS; round++) {
+	for (i = 0; i < BLOCKS; i++) {
+	    size_t size = 16 + (size_t)(rand() % 1025);
+
+	    if ((blocks[i] = malloc(size)) == NULL) {
+		printf("out of memory\n");
+		return 1;
+	    }
+	    memset(blocks[i], (int)i, size);
+	}
+	for (i = BLOCKS - 1; i > 0; i--) {
+	    j = (size_t)rand() % (i + 1);
+	    tmp = blocks[i];
+	    blocks[i] = blocks[j];
+	    blocks[j] = tmp;
+	}
+	for (i = 0; i < BLOCKS; i++) {
+	    t = now_ns();
+	    free(blocks[i]);
+	    frees[nfrees++] = now_ns() - t;
+	}
+    }
+    t = now_ns() - start;
+    thread_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID) - thread_cpu;
+    process_cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - process_cpu;
+    qsort(frees, nfrees, sizeof(double), compare_doubles);
+    printf("free() median %.0f ns, 99th percentile %.0f ns, total %.1f ms\n",
+	   frees[nfrees / 2], frees[nfrees * 99 / 100], t / 1e6);
+    printf("CPU time %.1f ms in this thread, %.1f ms in the others\n", thread_cpu / 1e6,
+	   process_cpu > thread_cpu ? (process_cpu - thread_cpu) / 1e6 : 0);	/* the clocks tick apart */
+
+    nanosleep(&idle, NULL);			/* let pending frees drain first */
+    before = context_switches();
+    nanosleep(&idle, NULL);
+    printf("context switches while idle for %d ms: %ld\n", IDLE_MS,
+	   context_switches() - before - 1);	/* not counting our own sleep */
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * mmkernels.c - cross-check of the best fit kernels of the free block index
+ *
+ * mm.c is included with FREE_INDEX so that its static kernels can be
+ * called directly.  Every kernel the processor supports is run on the
+ * same sizes, both made up ones full of ties and of every length around
+ * the vector widths, and the arrays of a real index, and each must pick
+ * the slot the scalar kernel picks.  The time per entry of each kernel
+ * over KERNEL_ENTRIES sizes is printed last.  Exits with 1 on a mismatch.
+ */
+#define FREE_INDEX 1
+#include "mm.c"
+
+#include <time.h>
+
+#define MAX_ENTRIES 67		/* longer than two AVX-512 vectors and a tail */
+#define KERNEL_ENTRIES 10000
+#define KERNEL_ROUNDS 2000
+
+struct kernel {
+    const char *name;
+    size_t (*search)(const size_t *sizes, size_t n, size_t asize);
+};
+
+static struct kernel kernels[3];
+static int nkernels;
+static unsigned long searches, mismatches;
+static unsigned int seed = 1;
+
+static unsigned int next_random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+/* Run every kernel on sizes[0..n) and compare its slot with the scalar one */
+static void cross_check(const size_t *sizes, size_t n, size_t asize)
+{
+    size_t want = best_fit_scalar(sizes, n, asize), got;
+    int k;
+
+    searches++;
+    for (k = 1; k < nkernels; k++) {
+	if ((got = kernels[k].search(sizes, n, asize)) != want) {
+	    if (mismatches++ < 10)
+		printf("%s picks slot %zu (size %zu), scalar slot %zu (size %zu), "
+		       "for %zu bytes in %zu entries\n", kernels[k].name, got,
+		       sizes[got], want, sizes[want], asize, n);
+	}
+    }
+}
+
+/* Made up arrays: few distinct sizes so that minima tie across lanes */
+static void made_up(void)
+{
+    size_t sizes[MAX_ENTRIES], n, i, asize;
+    int round;
+
+    for (n = 1; n <= MAX_ENTRIES; n++) {
+	for (round = 0; round < 200; round++) {
+	    for (i = 0; i < n; i++)
+		sizes[i] = DSIZE * (2 + next_random() % 8);
+	    for (asize = DSIZE; asize <= 11 * DSIZE; asize += DSIZE)
+		cross_check(sizes, n, asize);
+	}
+    }
+}
+
+/* The arrays of a heap fragmented by random frees */
+static void real_index(void)
+{
+    static void *blocks[20000];
+    size_t i, asize;
+    int class;
+
+    mem_init();
+    if (mm_init() < 0) {
+	printf("mm_init failed\n");
+	exit(1);
+    }
+    for (i = 0; i < 20000; i++)
+	blocks[i] = mm_malloc(1 + next_random() % 600);
+    for (i = 0; i < 20000; i++)
+	if (next_random() % 2)
+	    mm_free(blocks[i]);
+    for (class = 0; class < NO_SEG_CLASSES; class++) {
+	const struct index_class *ic = &heap->index[class];
+
+	if (ic->count == 0)
+	    continue;
+	for (asize = DSIZE; asize <= 64 * DSIZE; asize += DSIZE)
+	    cross_check(ic->sizes, ic->count, asize);
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Time per entry of a search which finds no fit, so the whole array is read */
+static void timing(void)
+{
+    static size_t sizes[KERNEL_ENTRIES];
+    volatile size_t sink = 0;
+    double start;
+    int k, round;
+    size_t i;
+
+    for (i = 0; i < KERNEL_ENTRIES; i++)
+	sizes[i] = DSIZE * (2 + next_random() % 64);
+    for (k = 0; k < nkernels; k++) {
+	start = now_ns();
+	for (round = 0; round < KERNEL_ROUNDS; round++)
+	    sink += kernels[k].search(sizes, KERNEL_ENTRIES, 100 * DSIZE);
+	printf("%-7s %.2f ns/entry\n", kernels[k].name,
+	       (now_ns() - start) / ((double)KERNEL_ROUNDS * KERNEL_ENTRIES));
+    }
+    (void)sink;
+}
+
+int main(void)
+{
+    kernels[nkernels++] = (struct kernel){ "scalar", best_fit_scalar };
+#if INDEX_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	kernels[nkernels++] = (struct kernel){ "avx2", best_fit_avx2 };
+    else
+	printf("no AVX2 on this processor, not checked\n");
+    if (__builtin_cpu_supports("avx512f"))
+	kernels[nkernels++] = (struct kernel){ "avx512", best_fit_avx512 };
+    else
+	printf("no AVX-512 on this processor, not checked\n");
+#endif
+    made_up();
+    real_index();
+    printf("%lu searches by %d kernels, %lu mismatches\n", searches, nkernels, mismatches);
+    timing();
+    return mismatches != 0;
+}
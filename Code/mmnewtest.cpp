@@ -0,0 +1,146 @@
+/*
+ * mmnewtest.cpp - run a C++ program on the replacement operator new/delete
+ *
+ * Linked with mm_new.o, so every new and delete below, and those of the
+ * standard containers, go to the mm heap.  Checks that the blocks come
+ * from that heap, that over-aligned and nothrow new behave as the standard
+ * asks, and that the heap stays consistent, then times sized against
+ * unsized delete, best of 5 runs.  Exits with 1 if a check failed.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define ROUNDS 200000
+#define OBJECT_SIZE 40
+
+static int failures = 0;
+static char *volatile kept;
+
+static void expect(bool ok, const char *what)
+{
+    if (!ok) {
+	std::printf("FAILED: %s\n", what);
+	failures++;
+    }
+}
+
+static bool in_heap(const void *p)
+{
+    return p >= mem_heap_lo() && p <= mem_heap_hi();
+}
+
+static void expect_consistent(const char *phase)
+{
+    char what[128];
+
+    std::snprintf(what, sizeof(what), "heap consistent after %s", phase);
+    mm_check_slice(SIZE_MAX);	/* finish the pass under way, then check the whole heap */
+    expect(mm_check_slice(SIZE_MAX) == 0, what);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void containers(void)
+{
+    std::vector<std::string> words;
+    std::map<int, std::string> index;
+
+    for (int i = 0; i < 5000; i++) {
+	words.push_back("a string long enough to be on the heap " + std::to_string(i));
+	index[i * 7 % 5000] = words.back();
+    }
+    expect(in_heap(words.data()), "vector storage is in the mm heap");
+    expect(in_heap(index.begin()->second.data()), "map strings are in the mm heap");
+    expect(index.size() == 5000 && index[7] == words[1], "containers hold their values");
+    words.erase(words.begin(), words.begin() + 2500);
+    words.shrink_to_fit();
+    index.clear();
+    expect_consistent("containers");
+}
+
+static void aligned(void)
+{
+    struct alignas(256) page_part {
+	char bytes[256];
+    };
+    page_part *parts = new page_part[10];
+    int *value = new int(42);
+
+    expect((uintptr_t)parts % 256 == 0, "align_val_t new returns aligned blocks");
+    expect(in_heap(parts) && in_heap(value), "aligned and plain new use the mm heap");
+    delete[] parts;
+    delete value;
+    expect_consistent("aligned new");
+}
+
+static void failures_reported(void)
+{
+    volatile std::size_t huge = SIZE_MAX / 4;
+    bool thrown = false;
+
+    expect(new (std::nothrow) char[huge] == NULL, "nothrow new returns NULL when out of memory");
+    try {
+	kept = new char[huge];	/* stored so that the new expression is not elided */
+	delete[] kept;
+    } catch (const std::bad_alloc &) {
+	thrown = true;
+    }
+    expect(thrown, "new throws bad_alloc when out of memory");
+    expect_consistent("failed new");
+}
+
+static double delete_ns(bool sized)
+{
+    static void *objects[ROUNDS];
+    double start, ns;
+
+    for (int i = 0; i < ROUNDS; i++)
+	objects[i] = ::operator new(OBJECT_SIZE + i % 4 * 16);
+    start = now_ns();
+    for (int i = 0; i < ROUNDS; i += 2) {	/* every other block, so that most frees do not coalesce */
+	if (sized)
+	    ::operator delete(objects[i], OBJECT_SIZE + i % 4 * 16);
+	else
+	    ::operator delete(objects[i]);
+    }
+    ns = (now_ns() - start) / (ROUNDS / 2);
+    for (int i = 1; i < ROUNDS; i += 2)
+	::operator delete(objects[i]);
+    expect_consistent(sized ? "sized delete" : "delete");
+    return ns;
+}
+
+int main(void)
+{
+    double plain, sized;
+
+    containers();
+    aligned();
+    failures_reported();
+    plain = sized = 1e9;
+    for (int run = 0; run < 5; run++) {	/* best of 5, alternating */
+	plain = std::min(plain, delete_ns(false));
+	sized = std::min(sized, delete_ns(true));
+    }
+    std::printf("delete %.1f ns, sized delete %.1f ns\n", plain, sized);
+    if (failures != 0)
+	return 1;
+    std::printf("mmnewtest: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * mmpmrtest.cpp - containers on the adapters of mm_pmr.h
+ *
+ * Puts pmr and allocator-aware containers on the default heap and on heaps
+ * of their own, and checks that their storage comes from the heap asked
+ * for, that over-aligned requests are honoured, that adapters compare
+ * equal exactly when they share a heap, and that running out of memory
+ * throws.  The default heap is checked after each phase.  Exits with 1 if
+ * a check failed.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "memlib.h"
+#include "mm_pmr.h"
+
+#define HEAP_MAX (64 * 1024)
+
+static int failures = 0;
+
+static void expect(bool ok, const char *what)
+{
+    if (!ok) {
+	std::printf("FAILED: %s\n", what);
+	failures++;
+    }
+}
+
+static bool in_default_heap(const void *p)
+{
+    return p >= mem_heap_lo() && p <= mem_heap_hi();
+}
+
+static void expect_consistent(const char *phase)
+{
+    char what[128];
+
+    std::snprintf(what, sizeof(what), "heap consistent after %s", phase);
+    mm_check_slice(SIZE_MAX);	/* finish the pass under way, then check the whole heap */
+    expect(mm_check_slice(SIZE_MAX) == 0, what);
+}
+
+static void default_heap(void)
+{
+    mm::heap_resource res;
+    std::pmr::vector<int> v(&res);
+    std::pmr::map<int, std::pmr::string> m(&res);
+    void *p;
+
+    for (int i = 0; i < 10000; i++)
+	v.push_back(i);
+    for (int i = 0; i < 1000; i++)
+	m[i] = "a string long enough to be on the heap";
+    expect(in_default_heap(v.data()), "pmr vector storage is in the default heap");
+    expect(in_default_heap(m[7].data()), "pmr map strings are in the default heap");
+    expect(v[9999] == 9999 && m.size() == 1000, "pmr containers hold their values");
+    p = res.allocate(100, 256);
+    expect((uintptr_t)p % 256 == 0, "over-aligned allocate is aligned");
+    res.deallocate(p, 100, 256);
+    expect_consistent("pmr containers on the default heap");
+}
+
+static void own_heap(void)
+{
+    mm_heap_t *heap = mm_heap_create(1 << 20);
+    {
+	mm::heap_resource res(heap), same(heap), other;
+	std::pmr::vector<std::pmr::string> v(&res);
+	std::vector<long, mm::allocator<long>> w{mm::allocator<long>(heap)};
+	std::list<int, mm::allocator<int>> l{mm::allocator<int>(heap)};
+
+	for (int i = 0; i < 1000; i++) {
+	    v.emplace_back("a string long enough to be on the heap");
+	    w.push_back(i);
+	    l.push_back(i);
+	}
+	expect(!in_default_heap(v.data()) && !in_default_heap(v[0].data()),
+	       "pmr containers on a heap of their own stay out of the default heap");
+	expect(!in_default_heap(w.data()) && !in_default_heap(&l.front()),
+	       "allocator containers on a heap of their own stay out of the default heap");
+	expect(w[999] == 999 && l.back() == 999, "containers hold their values");
+	expect(res == same && !(res == other), "resources are equal when they share a heap");
+	expect(mm::allocator<int>(heap) == mm::allocator<char>(heap) &&
+	       mm::allocator<int>(heap) != mm::allocator<int>(), "allocators are equal when they share a heap");
+    }
+    mm_heap_destroy(heap);
+    expect_consistent("containers on a heap of their own");
+}
+
+static void out_of_memory(void)
+{
+    mm_heap_t *heap = mm_heap_create(HEAP_MAX);
+    bool thrown = false;
+
+    {
+	mm::heap_resource res(heap);
+	std::pmr::vector<char> v(&res);
+
+	try {
+	    for (int i = 0; i < 2 * HEAP_MAX; i++)
+		v.push_back('x');
+	} catch (const std::bad_alloc &) {
+	    thrown = true;
+	}
+	expect(thrown, "a pmr vector outgrowing its heap throws bad_alloc");
+	expect(v.size() >= HEAP_MAX / 8 && v.size() < HEAP_MAX &&
+	       std::string(v.begin(), v.end()) == std::string(v.size(), 'x'), "the vector keeps what it held");
+
+	thrown = false;
+	try {
+	    mm::allocator<long>().allocate(SIZE_MAX / 4);
+	} catch (const std::bad_array_new_length &) {
+	    thrown = true;
+	}
+	expect(thrown, "an allocator request that overflows throws bad_array_new_length");
+
+	thrown = false;
+	try {
+	    mm::allocator<char>().allocate((std::size_t)1 << 40);
+	} catch (const std::bad_alloc &) {
+	    thrown = true;
+	}
+	expect(thrown, "an allocator request larger than the heap throws bad_alloc");
+    }
+    mm_heap_destroy(heap);
+    expect_consistent("running out of memory");
+}
+
+int main(void)
+{
+    mem_init();
+    if (mm_init() < 0) {
+	std::printf("mm_init failed\n");
+	return 1;
+    }
+    default_heap();
+    own_heap();
+    out_of_memory();
+    if (failures != 0)
+	return 1;
+    std::printf("mmpmrtest: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,932 @@
+/*
+ * mmtest.c - tests of the interface of mm.c beyond malloc, free and realloc
+ *
+ * Each test exercises one group of functions, the ways they fail included,
+ * on a fresh default heap, and has the incremental checker go over the
+ * whole heap after each of its phases.  "mmtest" runs every test, "mmtest
+ * <name>..." the ones named.  Failures are printed and make the exit status
+ * 1.  The requests meant to fail make memlib print "mem_sbrk failed".
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "mm_snapshot.h"
+
+#define EXPECT(cond) expect((cond), #cond, __LINE__)
+
+/* Larger than the 20 MB memlib heap, but no overflow in the size arithmetic */
+#define TOO_BIG ((size_t)1 << 40)
+
+struct test {
+    const char *name;
+    void (*run)(void);
+};
+
+static const char *current;	/* test running */
+static int failures;
+
+static void expect(int ok, const char *what, int line)
+{
+    if (!ok) {
+	printf("%s: line %d: FAILED: %s\n", current, line, what);
+	failures++;
+    }
+}
+
+/* Run the checker over the whole default heap */
+static void check_heap(const char *phase)
+{
+    mm_check_slice(SIZE_MAX);	/* finish the pass under way */
+    if (mm_check_slice(SIZE_MAX) != 0) {
+	printf("%s: heap inconsistent after %s\n", current, phase);
+	failures++;
+    }
+}
+
+/* Returns true if "size" bytes at "p" all hold "value" */
+static int filled(const void *p, int value, size_t size)
+{
+    const unsigned char *c = p;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+	if (c[i] != (unsigned char)value)
+	    return 0;
+    return 1;
+}
+
+/*
+ * mm_malloc_batch and mm_free_batch
+ */
+static void test_batch(void)
+{
+    static void *blocks[200000];
+    size_t n, i;
+
+    n = mm_malloc_batch(40, 1000, blocks);
+    EXPECT(n == 1000);
+    for (i = 0; i < n; i++) {
+	EXPECT(mm_usable_size(blocks[i]) >= 40);
+	memset(blocks[i], (int)i, 40);
+    }
+    for (i = 0; i < n; i++)
+	EXPECT(filled(blocks[i], (int)i, 40));
+    check_heap("a batch");
+
+    /* Out of order and with NULLs */
+    for (i = 0; i < n; i += 3)
+	blocks[i] = NULL;
+    for (i = 0; i + 1 < n; i += 2) {
+	void *tmp = blocks[i];
+
+	blocks[i] = blocks[i + 1];
+	blocks[i + 1] = tmp;
+    }
+    mm_free_batch(blocks, n);
+    check_heap("freeing a shuffled batch");
+
+    /* Failures: nothing asked, too big, more than the heap holds */
+    EXPECT(mm_malloc_batch(0, 10, blocks) == 0);
+    EXPECT(mm_malloc_batch(TOO_BIG, 4, blocks) == 0);
+    EXPECT(mm_malloc_batch(SIZE_MAX / 64, 1000, blocks) == 0);
+    EXPECT(mm_malloc_batch(SIZE_MAX, 2, blocks) == 0);
+    n = mm_malloc_batch(100, 200000, blocks);
+    EXPECT(n > 0 && n < 200000);
+    EXPECT(mm_malloc(100) == NULL);
+    check_heap("a batch that ran out of memory");
+    mm_free_batch(blocks, n);
+    EXPECT(mm_malloc_batch(100, 1000, blocks) == 1000);
+    check_heap("freeing a full heap");
+}
+
+/*
+ * mm_heap_create and the functions of independent heaps
+ */
+#define HEAP_MAX (64 * 1024)
+
+static void test_heaps(void)
+{
+    static void *blocks[HEAP_MAX / 32];
+    mm_heap_t *h, *g;
+    void *p, *first, *q;
+    size_t n, i;
+
+    p = mm_malloc(100);
+    memset(p, 0x5a, 100);
+
+    EXPECT((h = mm_heap_create(HEAP_MAX)) != NULL);
+    EXPECT((g = mm_heap_create(HEAP_MAX)) != NULL);
+    first = mm_heap_malloc(h, 48);
+    EXPECT(first != NULL && (first < mem_heap_lo() || first > mem_heap_hi()));
+    q = mm_heap_memalign(h, 256, 300);
+    EXPECT(q != NULL && (uintptr_t)q % 256 == 0);
+    EXPECT(mm_heap_malloc(g, 48) != first);
+    mm_heap_free(h, q);
+    check_heap("allocating from other heaps");
+
+    /* A heap never grows past its maximum, and never into the default heap */
+    for (n = 0; n < HEAP_MAX / 32; n++) {
+	if ((blocks[n] = mm_heap_malloc(h, 24)) == NULL)
+	    break;
+	memset(blocks[n], (int)n, 24);
+    }
+    EXPECT(n > HEAP_MAX / 64 && n < HEAP_MAX / 32);
+    EXPECT(mm_heap_malloc(h, HEAP_MAX) == NULL);
+    EXPECT(mm_heap_memalign(h, 4096, HEAP_MAX / 2) == NULL);
+    for (i = 0; i < n; i++)
+	EXPECT(filled(blocks[i], (int)i, 24));
+    EXPECT(mm_heap_malloc(g, 1000) != NULL);
+    EXPECT(filled(p, 0x5a, 100));
+    check_heap("filling a heap");
+
+    /* A freed block is taken again, a reset gives back the whole heap */
+    mm_heap_free(h, blocks[n / 2]);
+    EXPECT(mm_heap_malloc(h, 24) == blocks[n / 2]);
+    mm_heap_reset(h);
+    EXPECT(mm_heap_malloc(h, 48) == first);
+    EXPECT(mm_heap_malloc(h, HEAP_MAX / 2) != NULL);
+    mm_heap_destroy(h);
+    mm_heap_destroy(g);
+    EXPECT(filled(p, 0x5a, 100));
+    check_heap("reset and destroy");
+
+    /* Failures: no storage for the heap, no room for its first chunk, a
+     * size which wraps around with the descriptor */
+    EXPECT(mm_heap_create(SIZE_MAX / 2) == NULL);
+    EXPECT(mm_heap_create(16) == NULL);
+    EXPECT(mm_heap_create(SIZE_MAX) == NULL);
+    EXPECT(mm_heap_create(SIZE_MAX - 8) == NULL);
+    mm_free(p);
+    check_heap("failed creations");
+}
+
+/*
+ * Bump pointer regions
+ */
+static void test_regions(void)
+{
+    struct mm_stats before, after;
+    mm_region_mark_t mark;
+    mm_region_t *r;
+    char *p[3000], *q;
+    size_t i, size;
+
+    mm_stats(&before);
+    EXPECT((r = mm_region_create(1024)) != NULL);
+    for (i = 0; i < 1000; i++) {
+	size = 1 + i % 87;
+	p[i] = mm_region_malloc(r, size);
+	EXPECT(p[i] != NULL && (uintptr_t)p[i] % 16 == 0);
+	memset(p[i], (int)i, size);
+    }
+    for (i = 1; i < 1000; i++)
+	EXPECT(p[i] != p[i - 1]);
+    check_heap("bumping");
+
+    /* Release goes back to the mark, however many chunks were taken since */
+    mark = mm_region_mark(r);
+    q = mm_region_malloc(r, 40);
+    for (i = 1000; i < 3000; i++)
+	p[i] = mm_region_malloc(r, 40);
+    EXPECT(mm_region_malloc(r, 100000) != NULL);
+    check_heap("growing past the mark");
+    mm_region_release(r, mark);
+    EXPECT(mm_region_malloc(r, 40) == q);
+    for (i = 0; i < 1000; i++)
+	EXPECT(filled(p[i], (int)i, 1 + i % 87));
+    check_heap("releasing to a mark");
+
+    /* Failures: too big for the heap, or for the size arithmetic */
+    EXPECT(mm_region_malloc(r, TOO_BIG) == NULL);
+    EXPECT(mm_region_malloc(r, SIZE_MAX) == NULL);
+    EXPECT(mm_region_malloc(r, SIZE_MAX - 8) == NULL);
+    EXPECT(mm_region_malloc(r, 40) != NULL);
+    check_heap("failed region allocations");
+
+    mm_region_destroy(r);
+    mm_stats(&after);
+    EXPECT(after.live_bytes == before.live_bytes);
+    check_heap("destroying a region");
+}
+
+/*
+ * Object caches
+ */
+#define OBJECT_MAGIC 0x6f626a65
+
+struct object {
+    unsigned int magic;		/* set by the constructor only */
+    unsigned int uses;
+    char payload[40];
+};
+
+static size_t constructed, destroyed;
+
+static void object_ctor(void *p)
+{
+    struct object *o = p;
+
+    o->magic = OBJECT_MAGIC;
+    o->uses = 0;
+    constructed++;
+}
+
+static void object_dtor(void *p)
+{
+    struct object *o = p;
+
+    EXPECT(o->magic == OBJECT_MAGIC);
+    o->magic = 0;
+    destroyed++;
+}
+
+static void test_caches(void)
+{
+    static struct object *objects[400000];
+    struct object *o;
+    mm_cache_t *c, *aligned;
+    size_t n, i, reaped;
+    void *big;
+
+    EXPECT((c = mm_cache_create(sizeof(struct object), 0, object_ctor, object_dtor)) != NULL);
+    EXPECT((aligned = mm_cache_create(24, 64, NULL, NULL)) != NULL);
+    for (i = 0; i < 1000; i++) {
+	objects[i] = mm_cache_alloc(c);
+	EXPECT(objects[i] != NULL && objects[i]->magic == OBJECT_MAGIC);
+	objects[i]->uses++;
+	o = mm_cache_alloc(aligned);
+	EXPECT(o != NULL && (uintptr_t)o % 64 == 0);
+    }
+    check_heap("allocating objects");
+
+    /* A freed object comes back still constructed, with what it held */
+    mm_cache_free(c, objects[500]);
+    o = mm_cache_alloc(c);
+    EXPECT(o == objects[500] && o->magic == OBJECT_MAGIC && o->uses == 1);
+    for (i = 0; i < 1000; i++)
+	mm_cache_free(c, objects[i]);
+    EXPECT(destroyed == 0);
+    reaped = mm_cache_reap();
+    EXPECT(reaped > 0 && destroyed == constructed);
+    EXPECT(mm_cache_reap() == 0);
+    check_heap("reaping");
+
+    /* Filling the heap with objects, then a malloc which needs their slabs */
+    for (n = 0; n < 400000; n++)
+	if ((objects[n] = mm_cache_alloc(c)) == NULL)
+	    break;
+    EXPECT(n > 0 && n < 400000);
+    EXPECT(mm_malloc(1 << 20) == NULL);
+    check_heap("running out of slabs");
+    for (i = 0; i < n; i++)
+	mm_cache_free(c, objects[i]);
+    EXPECT((big = mm_malloc(1 << 20)) != NULL);
+    EXPECT(destroyed > 0);
+    mm_free(big);
+    check_heap("a malloc reaping the caches");
+
+    mm_cache_destroy(aligned);
+    mm_cache_destroy(c);
+    EXPECT(destroyed == constructed);
+    check_heap("destroying caches");
+
+    /* Failures: empty objects, alignment not a power of two, too big */
+    EXPECT(mm_cache_create(0, 8, NULL, NULL) == NULL);
+    EXPECT(mm_cache_create(16, 24, NULL, NULL) == NULL);
+    EXPECT(mm_cache_create(SIZE_MAX / 2, 8, NULL, NULL) == NULL);
+    EXPECT((c = mm_cache_create(TOO_BIG, 8, NULL, NULL)) == NULL || mm_cache_alloc(c) == NULL);
+    if (c != NULL)
+	mm_cache_destroy(c);
+    check_heap("failed caches");
+}
+
+/*
+ * mm_free_sized, with the size given and with a size that is only a lower
+ * bound of the block
+ */
+static void test_sized(void)
+{
+    struct mm_stats before, after;
+    void *p[1000], *q;
+    size_t i;
+
+    mm_stats(&before);
+    for (i = 0; i < 1000; i++)
+	p[i] = mm_malloc(1 + i % 300);
+    for (i = 0; i < 1000; i += 2)	/* neighbours allocated */
+	mm_free_sized(p[i], 1 + i % 300);
+    check_heap("sized frees between allocated blocks");
+    for (i = 1; i < 1000; i += 2)	/* neighbours free */
+	mm_free_sized(p[i], 1 + i % 300);
+    mm_stats(&after);
+    EXPECT(after.live_bytes == before.live_bytes);
+    check_heap("sized frees next to free blocks");
+
+    /* Blocks larger than the size given, or with flags, take the mm_free path */
+    p[0] = mm_malloc(100);
+    p[1] = mm_realloc(mm_malloc(40), 100);
+    p[2] = mm_malloc_tagged(200, 7);
+    p[3] = mm_malloc_lifetime(64, MM_LIFETIME_SHORT);
+    p[4] = mm_malloc(100);
+    EXPECT((q = mm_realloc(p[0], 60)) == p[0]);
+    mm_free_sized(q, 60);
+    mm_free_sized(p[1], 40);
+    mm_free_sized(p[2], 200);
+    EXPECT(mm_tag_live(7) == 0);
+    mm_free_sized(p[3], 64);
+    mm_free_sized(p[4], 100);
+    mm_free_sized(NULL, 10);
+    mm_stats(&after);
+    EXPECT(after.live_bytes == before.live_bytes);
+    check_heap("sized frees of resized and flagged blocks");
+}
+
+/*
+ * Lifetime hints, given and learned per site
+ */
+static int in_default_heap(const void *p)
+{
+    return p >= mem_heap_lo() && p <= mem_heap_hi();
+}
+
+static void test_lifetime(void)
+{
+    static void *blocks[1000];
+    struct mm_stats before, after;
+    void *s, *l, *p;
+    size_t n, i;
+    int moved;
+
+    mm_stats(&before);
+    s = mm_malloc_lifetime(100, MM_LIFETIME_SHORT);
+    l = mm_malloc_lifetime(100, MM_LIFETIME_LONG);
+    EXPECT(s != NULL && !in_default_heap(s));
+    EXPECT(l != NULL && in_default_heap(l));
+    memset(s, 0x33, 100);
+    check_heap("hinted allocations");
+
+    /* realloc keeps a short lived block in its heap while it fits there */
+    EXPECT((s = mm_realloc(s, 2000)) != NULL && !in_default_heap(s) && filled(s, 0x33, 100));
+    EXPECT((s = mm_realloc(s, 5 << 20)) != NULL && in_default_heap(s) && filled(s, 0x33, 100));
+    mm_free(s);
+    mm_free(l);
+    check_heap("moving a short lived block out of its heap");
+
+    /* A full short lived heap sends the next blocks to the default heap */
+    for (n = 0, moved = 0; n < 1000 && !moved; n++) {
+	blocks[n] = mm_malloc_lifetime(64 << 10, MM_LIFETIME_SHORT);
+	moved = blocks[n] != NULL && in_default_heap(blocks[n]);
+    }
+    EXPECT(moved && n > 1);
+    mm_free_batch(blocks, n);
+    EXPECT(mm_malloc_lifetime(TOO_BIG, MM_LIFETIME_SHORT) == NULL);
+    EXPECT(mm_malloc_lifetime(TOO_BIG, MM_LIFETIME_LONG) == NULL);
+    check_heap("filling the short lived heap");
+
+    /* A site freeing its blocks at once is learned to be short lived, a
+     * site keeping them is not */
+    for (i = 0; i < 1000; i++)
+	mm_free(mm_malloc_site(48, 0x1000));
+    for (i = 0; i < 1000; i++)
+	blocks[i] = mm_malloc_site(48, 0x2000);
+    p = mm_malloc_site(48, 0x1000);
+    EXPECT(!in_default_heap(p));
+    mm_free(p);
+    for (i = 0; i < 1000; i++)
+	EXPECT(in_default_heap(blocks[i]));
+    mm_free_batch(blocks, 1000);
+    for (i = 0; i <= 1000; i++) {	/* one call site, the last block is kept */
+	p = mm_malloc_caller(48);
+	if (i < 1000)
+	    mm_free(p);
+    }
+    EXPECT(!in_default_heap(p));
+    mm_free(p);
+    mm_stats(&after);
+    EXPECT(after.live_bytes == before.live_bytes);
+    check_heap("learning sites");
+}
+
+/*
+ * mm_malloc_near
+ */
+static void test_near(void)
+{
+    static char *blocks[2000];
+    char *hint, *p, *s;
+    size_t i;
+    long distance;
+
+    for (i = 0; i < 2000; i++)
+	blocks[i] = mm_malloc(32 + i % 64);
+    for (i = 0; i < 2000; i += 4)
+	mm_free(blocks[i]);
+    check_heap("fragmenting the heap");
+
+    /* The block is taken from a hole next to the hint, not from the lists */
+    hint = blocks[1001];
+    p = mm_malloc_near(hint, 24);
+    distance = p - hint;
+    EXPECT(p != NULL && (distance < 0 ? -distance : distance) < 256);
+    memset(p, 0x44, 24);
+    EXPECT((p = mm_malloc_near(blocks[1999], 4000)) != NULL);
+    memset(p, 0x45, 4000);
+    EXPECT(mm_malloc_near(NULL, 100) != NULL);
+    check_heap("allocating near blocks");
+
+    /* Near a block of the short lived heap is in that heap */
+    s = mm_malloc_lifetime(64, MM_LIFETIME_SHORT);
+    p = mm_malloc_near(s, 64);
+    EXPECT(p != NULL && (p < (char *)mem_heap_lo() || p > (char *)mem_heap_hi()));
+    mm_free(p);
+    mm_free(s);
+
+    /* Failures: nothing to allocate, too big */
+    EXPECT(mm_malloc_near(hint, 0) == NULL);
+    EXPECT(mm_malloc_near(hint, TOO_BIG) == NULL);
+    EXPECT(mm_malloc_near(NULL, TOO_BIG) == NULL);
+    EXPECT(mm_malloc_near(hint, SIZE_MAX) == NULL);
+    check_heap("failed near allocations");
+}
+
+/*
+ * mm_malloc_flags
+ */
+#define LINE 64
+
+static void test_flags(void)
+{
+    char *counters[4], *buffers[8];
+    size_t i, j, offset;
+
+    /* Isolated blocks have their lines to themselves */
+    for (i = 0; i < 4; i++) {
+	counters[i] = mm_malloc_flags(8, MM_ISOLATE);
+	EXPECT(counters[i] != NULL && (uintptr_t)counters[i] % LINE == 0);
+	EXPECT(mm_usable_size(counters[i]) >= LINE);
+	memset(counters[i], (int)i, LINE);
+    }
+    for (i = 0; i < 4; i++)
+	for (j = 0; j < i; j++)
+	    EXPECT(counters[i] - counters[j] >= LINE || counters[j] - counters[i] >= LINE);
+    for (i = 0; i < 4; i++)
+	EXPECT(filled(counters[i], (int)i, LINE));
+    check_heap("isolated blocks");
+
+    /* Colored blocks start at successive lines of a page */
+    for (i = 0; i < 8; i++) {
+	buffers[i] = mm_malloc_flags(16 << 10, MM_COLOR);
+	EXPECT(buffers[i] != NULL);
+	memset(buffers[i], (int)i, 16 << 10);
+    }
+    for (i = 1; i < 8; i++) {
+	offset = (uintptr_t)buffers[i - 1] % 4096;
+	EXPECT((uintptr_t)buffers[i] % 4096 == (offset + LINE) % 4096);
+    }
+    check_heap("colored blocks");
+    for (i = 0; i < 8; i++) {
+	EXPECT(filled(buffers[i], (int)i, 16 << 10));
+	mm_free(buffers[i]);
+    }
+    for (i = 0; i < 4; i++)
+	mm_free(counters[i]);
+    EXPECT(mm_malloc_flags(100, 0) != NULL);
+    check_heap("freeing flagged blocks");
+
+    /* Failures: too big, and so big that the rounding and alignment would wrap */
+    EXPECT(mm_malloc_flags(TOO_BIG, MM_ISOLATE) == NULL);
+    EXPECT(mm_malloc_flags(TOO_BIG, MM_COLOR) == NULL);
+    EXPECT(mm_malloc_flags(SIZE_MAX - 8, MM_ISOLATE) == NULL);
+    EXPECT(mm_malloc_flags(SIZE_MAX - 200, MM_ISOLATE) == NULL);
+    EXPECT(mm_malloc_flags(SIZE_MAX - 100, MM_COLOR) == NULL);
+    EXPECT(mm_memalign(64, SIZE_MAX - 200) == NULL);
+    EXPECT(mm_memalign(SIZE_MAX / 2 + 1, 100) == NULL);
+    check_heap("failed flagged allocations");
+}
+
+/*
+ * Movable blocks, the compactor and mm_trim
+ */
+#define HANDLES 10000		/* more than one region of handles */
+
+static size_t heap_size(void)
+{
+    struct mm_stats st;
+
+    mm_stats(&st);
+    return st.heap_size;
+}
+
+/* Compact until a whole pass moves nothing, checking the heap on the way */
+static void compact_all(void)
+{
+    int idle = 0, calls = 0;
+
+    while (idle < 64 && calls < 100000) {
+	idle = mm_compact(16 << 10) == 0 ? idle + 1 : 0;
+	if (++calls % 16 == 0)
+	    check_heap("a step of compaction");
+    }
+}
+
+static void test_handles(void)
+{
+    static mm_handle_t handles[HANDLES];
+    size_t i, before, size;
+    char *pinned, *p;
+
+    for (i = 0; i < HANDLES; i++) {
+	size = 16 + i % 240;
+	EXPECT((handles[i] = mm_handle_alloc(size)) != NULL);
+	memset(mm_handle_pin(handles[i]), (int)i, size);
+	mm_handle_unpin(handles[i]);
+    }
+    check_heap("allocating movable blocks");
+    for (i = 0; i < HANDLES; i++) {
+	if (i % 3 != 0) {
+	    mm_handle_free(handles[i]);
+	    handles[i] = NULL;
+	}
+    }
+    mm_handle_free(NULL);
+    check_heap("freeing movable blocks");
+
+    /* Compaction moves every unpinned block down and shrinks the heap, a
+     * pinned block stays where it is and holds the free space below it */
+    pinned = mm_handle_pin(handles[HANDLES / 6 * 3]);
+    before = heap_size();
+    compact_all();
+    EXPECT(heap_size() < before * 3 / 4 && heap_size() > before / 2);
+    EXPECT(mm_handle_pin(handles[HANDLES / 6 * 3]) == pinned);
+    mm_handle_unpin(handles[HANDLES / 6 * 3]);
+    mm_handle_unpin(handles[HANDLES / 6 * 3]);
+    compact_all();
+    EXPECT(heap_size() < before / 2);
+    for (i = 0; i < HANDLES; i += 3) {
+	p = mm_handle_pin(handles[i]);
+	EXPECT(filled(p, (int)i, 16 + i % 240));
+	mm_handle_unpin(handles[i]);
+    }
+    check_heap("compacting");
+
+    /* Handles freed are taken again, and a failed allocation gives its handle back */
+    EXPECT(mm_handle_alloc(TOO_BIG) == NULL);
+    EXPECT(mm_handle_alloc(SIZE_MAX - 4) == NULL);
+    EXPECT(mm_handle_alloc(SIZE_MAX) == NULL);
+    for (i = 1; i < HANDLES; i += 3)
+	EXPECT((handles[i] = mm_handle_alloc(100)) != NULL);
+    for (i = 0; i < HANDLES; i++)
+	mm_handle_free(handles[i]);
+    compact_all();
+    check_heap("failed and freed handles");
+
+    /* mm_trim gives the top of the heap back, keeping what it is asked to */
+    p = mm_malloc(1 << 20);
+    mm_free(p);
+    before = heap_size();
+    EXPECT(mm_trim(64 << 10) > 0 && heap_size() < before && heap_size() >= (64 << 10));
+    EXPECT(mm_trim(0) > 0 && mm_trim(0) == 0);
+    EXPECT(mm_malloc(1000) != NULL);
+    check_heap("trimming");
+}
+
+/*
+ * Tagged allocation and tag limits
+ */
+#define TAG 7
+#define OTHER_TAG 9
+
+static int soft_calls, hard_calls;
+static void *victims[16];		/* blocks the callback may free */
+static int nvictims;
+
+static void limit_reached(unsigned int tag, int limit, size_t live)
+{
+    EXPECT(tag == TAG && live == mm_tag_live(TAG));
+    if (limit == MM_LIMIT_SOFT) {
+	soft_calls++;
+	return;
+    }
+    hard_calls++;
+    while (nvictims > 0)
+	mm_free(victims[--nvictims]);
+}
+
+static void test_tags(void)
+{
+    void *p[100], *q, *big;
+    size_t live, n, i;
+
+    /* Live bytes follow malloc, realloc and the frees */
+    p[0] = mm_malloc_tagged(100, TAG);
+    p[1] = mm_malloc_tagged(200, TAG);
+    p[2] = mm_malloc_tagged(300, OTHER_TAG);
+    EXPECT(mm_tag_live(TAG) == mm_usable_size(p[0]) + mm_usable_size(p[1]) + 2 * 16);
+    EXPECT(mm_tag_live(OTHER_TAG) == mm_usable_size(p[2]) + 16);
+    memset(p[0], 0x70, 100);
+    EXPECT((p[0] = mm_realloc(p[0], 5000)) != NULL && filled(p[0], 0x70, 100));
+    EXPECT(mm_tag_live(TAG) == mm_usable_size(p[0]) + mm_usable_size(p[1]) + 2 * 16);
+    mm_free(p[0]);
+    mm_free_batch(&p[1], 2);
+    EXPECT(mm_tag_live(TAG) == 0 && mm_tag_live(OTHER_TAG) == 0);
+    EXPECT(mm_malloc_tagged(100, 0) != NULL && mm_tag_live(0) == 0);
+    check_heap("tagged blocks");
+
+    /* Past the soft limit the callback is told, past the hard one the allocation fails */
+    mm_tag_set_callback(limit_reached);
+    mm_tag_set_limits(TAG, 1000, 2000);
+    for (n = 0; n < 100; n++)
+	if ((p[n] = mm_malloc_tagged(100, TAG)) == NULL)
+	    break;
+    EXPECT(n > 0 && n < 100 && soft_calls > 0 && hard_calls == 1);
+    EXPECT(mm_tag_live(TAG) <= 2000 && mm_tag_live(TAG) > 1000);
+    live = mm_tag_live(TAG);
+    q = p[0];
+    EXPECT(mm_realloc(p[0], 2000) == NULL && mm_tag_live(TAG) == live);
+    EXPECT(mm_realloc(p[0], 500) == NULL && mm_tag_live(TAG) == live);
+    EXPECT(mm_malloc_tagged(TOO_BIG, TAG) == NULL && mm_tag_live(TAG) == live);
+    EXPECT(mm_malloc_tagged(SIZE_MAX, TAG) == NULL && mm_tag_live(TAG) == live);
+    check_heap("a tag at its hard limit");
+
+    /* A callback which frees blocks of the tag lets the allocation through */
+    for (i = 1; i < 5; i++)
+	victims[nvictims++] = p[i];
+    EXPECT((big = mm_malloc_tagged(300, TAG)) != NULL && nvictims == 0);
+    EXPECT(mm_tag_live(TAG) <= 2000);
+    mm_free(big);
+    for (i = 5; i < n; i++)
+	mm_free(p[i]);
+    mm_free(q);
+    EXPECT(mm_tag_live(TAG) == 0);
+    check_heap("freeing from the callback");
+
+    /* Failures: tags out of range, nothing to allocate, too big without limits */
+    mm_tag_set_limits(TAG, 0, 0);
+    mm_tag_set_callback(NULL);
+    EXPECT(mm_malloc_tagged(100, MM_TAGS) == NULL);
+    EXPECT(mm_malloc_tagged(0, TAG) == NULL);
+    EXPECT(mm_malloc_tagged(TOO_BIG, TAG) == NULL);
+    EXPECT(mm_malloc_tagged(SIZE_MAX, TAG) == NULL);
+    EXPECT(mm_tag_live(MM_TAGS) == 0 && mm_tag_live(TAG) == 0);
+    check_heap("failed tagged allocations");
+}
+
+/*
+ * The heap profile
+ */
+#define PROF_INTERVAL (16 << 10)
+#define PROF_SMALL 40000	/* 4 MB in blocks of 100 bytes */
+#define PROF_LARGE 200		/* 1 MB in blocks of 5000 bytes */
+#define PROF_HANDLES 100
+
+/* Call sites of their own, global and not inlined so that the profile names them */
+__attribute__((noinline)) void prof_site_small(void **blocks, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	blocks[i] = mm_malloc(100);
+}
+
+__attribute__((noinline)) void prof_site_large(void **blocks, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	blocks[i] = mm_malloc(5000);
+}
+
+/* Dump the profile and add up its samples: all of them and those of the
+ * stacks holding "frame".  Returns the number of samples. */
+static int prof_read(const char *frame, size_t *bytes, size_t *frame_bytes)
+{
+    char line[4096], *weight;
+    FILE *f = tmpfile();
+    int samples = 0;
+
+    *bytes = *frame_bytes = 0;
+    if (f == NULL) {
+	printf("%s: no temporary file\n", current);
+	failures++;
+	return 0;
+    }
+    EXPECT(mm_prof_dump(fileno(f)) == 0);
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+	EXPECT((weight = strrchr(line, ' ')) != NULL && strstr(line, ";mm_malloc ") != NULL);
+	if (weight == NULL)
+	    continue;
+	samples++;
+	*bytes += strtoul(weight + 1, NULL, 10);
+	if (strstr(line, frame) != NULL)
+	    *frame_bytes += strtoul(weight + 1, NULL, 10);
+    }
+    fclose(f);
+    return samples;
+}
+
+static void test_prof(void)
+{
+    static void *small[PROF_SMALL], *large[PROF_LARGE];
+    mm_handle_t handles[PROF_HANDLES];
+    void *plain[4 * PROF_HANDLES];
+    size_t bytes, site_bytes, before;
+    int samples, i;
+
+    /* Nothing is sampled until an interval is set */
+    prof_site_small(small, 1000);
+    EXPECT(prof_read("", &bytes, &site_bytes) == 0);
+    for (i = 0; i < 1000; i++)
+	mm_free(small[i]);
+
+    /* Each site gets about the bytes it allocated */
+    mm_prof_set_interval(PROF_INTERVAL);
+    prof_site_small(small, PROF_SMALL);
+    prof_site_large(large, PROF_LARGE);
+    samples = prof_read("prof_site_small", &bytes, &site_bytes);
+    EXPECT(samples > 0);
+    EXPECT(site_bytes > PROF_SMALL * 100 / 4 * 3 && site_bytes < PROF_SMALL * 100 / 4 * 5);
+    before = site_bytes;
+    prof_read("prof_site_large", &bytes, &site_bytes);
+    EXPECT(site_bytes > PROF_LARGE * 5000 / 2 && site_bytes < PROF_LARGE * 5000 * 2);
+    EXPECT(mm_malloc(TOO_BIG) == NULL && prof_read("", &bytes, &site_bytes) == samples);
+    EXPECT(mm_prof_dump(-1) == -1);
+    check_heap("sampling two call sites");
+
+    /* Freeing a sampled block drops its sample, by mm_free and by mm_free_batch */
+    for (i = 0; i < PROF_LARGE; i++)
+	mm_free(large[i]);
+    prof_read("prof_site_large", &bytes, &site_bytes);
+    EXPECT(site_bytes == 0);
+    prof_read("prof_site_small", &bytes, &site_bytes);
+    EXPECT(site_bytes == before && bytes == before);
+    mm_free_batch(small, PROF_SMALL / 2);
+    prof_read("prof_site_small", &bytes, &site_bytes);
+    EXPECT(site_bytes < before * 3 / 4);
+    check_heap("freeing sampled blocks");
+
+    /* With the interval back at 0 no more samples are taken, those taken stay */
+    mm_prof_set_interval(0);
+    samples = prof_read("", &bytes, &site_bytes);
+    prof_site_large(large, PROF_LARGE);
+    EXPECT(prof_read("", &bytes, &site_bytes) == samples);
+    for (i = 0; i < PROF_LARGE; i++)
+	mm_free(large[i]);
+    mm_free_batch(small + PROF_SMALL / 2, PROF_SMALL / 2);
+    EXPECT(prof_read("", &bytes, &site_bytes) == 0);
+    check_heap("stopping the profile");
+
+    /* A sampled movable block keeps its sample when compaction moves it */
+    for (i = 0; i < 4 * PROF_HANDLES; i++)
+	plain[i] = mm_malloc(64);
+    mm_prof_set_interval(1);
+    for (i = 0; i < PROF_HANDLES; i++)
+	handles[i] = mm_handle_alloc(64);
+    mm_prof_set_interval(0);
+    EXPECT(prof_read("mm_handle_alloc", &bytes, &site_bytes) == PROF_HANDLES && site_bytes == bytes);
+    before = bytes;
+    for (i = 0; i < 4 * PROF_HANDLES; i++)
+	mm_free(plain[i]);
+    compact_all();
+    EXPECT(prof_read("mm_handle_alloc", &bytes, &site_bytes) == PROF_HANDLES && bytes == before);
+    check_heap("moving sampled blocks");
+    for (i = 0; i < PROF_HANDLES; i++)
+	mm_handle_free(handles[i]);
+    EXPECT(prof_read("", &bytes, &site_bytes) == 0);
+    check_heap("freeing sampled movable blocks");
+}
+
+/*
+ * Heap snapshots
+ */
+#define DUMP_BLOCKS 3000
+
+/* The record of the block at "p" among the "n" of "blocks", or NULL */
+static const struct mm_snapshot_block *dump_find(const struct mm_snapshot_block *blocks, size_t n,
+						  const void *p)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	if (blocks[i].addr == (uintptr_t)p)
+	    return &blocks[i];
+    return NULL;
+}
+
+static void test_dump(void)
+{
+    static struct mm_snapshot_block blocks[DUMP_BLOCKS + 16];
+    static void *p[DUMP_BLOCKS];
+    const struct mm_snapshot_block *b;
+    struct mm_snapshot_header hdr;
+    struct mm_stats st;
+    size_t n, i, free_bytes, free_blocks;
+    void *tagged, *sampled, *marked;
+    mm_handle_t handle;
+    FILE *f;
+
+    for (i = 0; i < DUMP_BLOCKS; i++)
+	p[i] = mm_malloc(16 + i % 500);
+    for (i = 0; i < DUMP_BLOCKS; i += 3)
+	mm_free(p[i]);
+    tagged = mm_malloc_tagged(100, 5);
+    handle = mm_handle_alloc(100);
+    mm_prof_set_interval(1);
+    sampled = mm_malloc(100);
+    mm_prof_set_interval(0);
+    marked = mm_malloc(100);
+    EXPECT(mm_free_mark(marked) == 0);
+    check_heap("filling the heap");
+
+    /* The header describes the heap, the records tile it */
+    if ((f = tmpfile()) == NULL) {
+	printf("%s: no temporary file\n", current);
+	failures++;
+	return;
+    }
+    EXPECT(mm_dump_heap(fileno(f)) == 0);
+    rewind(f);
+    EXPECT(fread(&hdr, sizeof(hdr), 1, f) == 1);
+    n = fread(blocks, sizeof(blocks[0]), sizeof(blocks) / sizeof(blocks[0]), f);
+    fclose(f);
+    EXPECT(hdr.magic == MM_SNAPSHOT_MAGIC && hdr.version == MM_SNAPSHOT_VERSION);
+    EXPECT(hdr.heap_lo == (uintptr_t)mem_heap_lo() && hdr.heap_size == mem_heapsize());
+    EXPECT(hdr.page_size == mem_pagesize() && hdr.word_size == sizeof(void *));
+    EXPECT(hdr.blocks == n && n > DUMP_BLOCKS / 3 * 2 && n < sizeof(blocks) / sizeof(blocks[0]));
+    for (i = 1; i < n; i++)
+	EXPECT(blocks[i].addr == blocks[i - 1].addr + blocks[i - 1].size);
+    EXPECT(n > 0 && blocks[n - 1].addr + blocks[n - 1].size == hdr.heap_lo + hdr.heap_size);
+
+    /* The records agree with the statistics and carry the flags and tags of the blocks */
+    mm_stats(&st);
+    for (i = 0, free_bytes = free_blocks = 0; i < n; i++) {
+	if (!(blocks[i].flags & MM_SNAPSHOT_ALLOC)) {
+	    EXPECT(blocks[i].flags == 0);
+	    free_bytes += blocks[i].size;
+	    free_blocks++;
+	}
+    }
+    EXPECT(free_bytes == st.free_bytes && free_blocks == st.free_blocks);
+    EXPECT((b = dump_find(blocks, n, p[1])) != NULL && b->flags == MM_SNAPSHOT_ALLOC && b->tag == 0);
+    EXPECT((b = dump_find(blocks, n, tagged)) != NULL && b->tag == 5);
+    EXPECT((b = dump_find(blocks, n, sampled)) != NULL && (b->flags & MM_SNAPSHOT_SAMPLED));
+    EXPECT((b = dump_find(blocks, n, marked)) != NULL && (b->flags & MM_SNAPSHOT_FREED));
+    EXPECT((b = dump_find(blocks, n, p[0])) == NULL ||
+	   !(b->flags & MM_SNAPSHOT_ALLOC));
+    for (i = 0; i < n && !(blocks[i].flags & MM_SNAPSHOT_MOVABLE); i++)
+	;
+    EXPECT(i < n && blocks[i].size >= 100);
+    check_heap("dumping the heap");
+
+    /* A write which fails makes the dump fail */
+    EXPECT(mm_dump_heap(-1) == -1);
+    mm_free(marked);
+    mm_free(sampled);
+    mm_free(tagged);
+    mm_handle_free(handle);
+    check_heap("a failed dump");
+}
+
+static const struct test tests[] = {
+    { "batch", test_batch },
+    { "heaps", test_heaps },
+    { "regions", test_regions },
+    { "caches", test_caches },
+    { "sized", test_sized },
+    { "lifetime", test_lifetime },
+    { "near", test_near },
+    { "flags", test_flags },
+    { "handles", test_handles },
+    { "tags", test_tags },
+    { "prof", test_prof },
+    { "dump", test_dump },
+};
+
+int main(int argc, char **argv)
+{
+    size_t i;
+    int j, run, before;
+
+    mem_init();
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+	run = argc == 1;
+	for (j = 1; j < argc; j++)
+	    run |= strcmp(argv[j], tests[i].name) == 0;
+	if (!run)
+	    continue;
+	current = tests[i].name;
+	mem_reset_brk();
+	if (mm_init() < 0) {
+	    printf("%s: mm_init failed\n", current);
+	    return 1;
+	}
+	before = failures;
+	tests[i].run();
+	printf("%-10s %s\n", current, failures > before ? "FAILED" : "ok");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * mmtop.c - watch the allocator of a running program
+ *
+ *     MM_STATS_SHM=1 LD_PRELOAD=./libmm.so program &
+ *     ./mmtop <pid> [interval in seconds [count]]
+ *
+ * Reads the statistics segment the program publishes (see mm_shm.h) and
+ * prints the heap size and its growth, the live and free bytes, the
+ * fragmentation of the free space and the free bytes of each segregated
+ * class once per interval.  Reading the segment does not stop or slow the
+ * program, mmtop only maps it read-only.
+ */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm_shm.h"
+
+#define READ_TRIES 1000
+
+/*
+ * Copy a consistent snapshot of the segment into "out": the copy is made
+ * again while the allocator was writing during it.  Returns 0 on success
+ * and -1 if no consistent copy could be made.
+ */
+static int read_segment(const struct mm_shm_stats *segment, struct mm_shm_stats *out)
+{
+    uint64_t before, after;
+    int i;
+
+    for (i = 0; i < READ_TRIES; i++) {
+	before = __atomic_load_n(&segment->seq, __ATOMIC_ACQUIRE);
+	if (before & 1)
+	    continue;
+	memcpy(out, (const void *)segment, sizeof(*out));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	after = __atomic_load_n(&segment->seq, __ATOMIC_RELAXED);
+	if (before == after)
+	    return 0;
+    }
+    return -1;
+}
+
+static void print_bytes(size_t bytes)
+{
+    if (bytes >= (1 << 20))
+	printf("%7.1f MB", bytes / 1048576.0);
+    else
+	printf("%7.1f KB", bytes / 1024.0);
+}
+
+static void print_snapshot(const struct mm_shm_stats *now, const struct mm_shm_stats *prev,
+			   double interval)
+{
+    const struct mm_stats *st = &now->stats;
+    double growth = ((double)st->heap_size - (double)prev->stats.heap_size) / interval;
+    int i;
+
+    printf("heap ");
+    print_bytes(st->heap_size);
+    printf("  live ");
+    print_bytes(st->live_bytes);
+    printf(" (%3.0f%%)  free ", st->heap_size ? 100.0 * st->live_bytes / st->heap_size : 0.0);
+    print_bytes(st->free_bytes);
+    printf(" in %zu blocks\n", st->free_blocks);
+
+    printf("growth %+.1f KB/s  calls %llu (%.0f/s)  largest free ",
+	   growth / 1024.0, (unsigned long long)now->calls,
+	   (double)(now->calls - prev->calls) / interval);
+    print_bytes(st->largest_free);
+    /* The share of the free space which is not in the largest free block */
+    printf("  fragmentation %3.0f%%\n",
+	   st->free_bytes ? 100.0 * (1.0 - (double)st->largest_free / st->free_bytes) : 0.0);
+
+    printf("splits %lu  coalesces %lu  extends %lu\n", st->splits, st->coalesces, st->extends);
+    printf("class   free bytes   blocks\n");
+    for (i = 0; i < MM_STATS_CLASSES; i++) {
+	printf("%5d ", i);
+	print_bytes(st->class_free_bytes[i]);
+	printf(" %8zu\n", st->class_free_blocks[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    char name[MM_SHM_NAME_SIZE];
+    struct mm_shm_stats *segment;
+    struct mm_shm_stats now, prev;
+    double interval = 1.0;
+    struct timespec pause;
+    long pid, count = -1;
+    int fd;
+
+    if (argc < 2 || argc > 4) {
+	fprintf(stderr, "usage: %s <pid> [interval in seconds [count]]\n", argv[0]);
+	exit(1);
+    }
+    pid = atol(argv[1]);
+    if (argc > 2 && (interval = atof(argv[2])) <= 0) {
+	fprintf(stderr, "%s: bad interval %s\n", argv[0], argv[2]);
+	exit(1);
+    }
+    if (argc > 3)
+	count = atol(argv[3]);
+
+    snprintf(name, sizeof(name), MM_SHM_NAME_FORMAT, pid);
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+	fprintf(stderr, "%s: no statistics for process %ld, was it started with MM_STATS_SHM set?\n",
+		argv[0], pid);
+	exit(1);
+    }
+    segment = mmap(NULL, sizeof(*segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+	perror("mmap");
+	exit(1);
+    }
+    if (read_segment(segment, &prev) < 0 || prev.magic != MM_SHM_MAGIC ||
+	prev.version != MM_SHM_VERSION) {
+	fprintf(stderr, "%s: %s is not a statistics segment of this version\n", argv[0], name);
+	exit(1);
+    }
+
+    pause.tv_sec = (time_t)interval;
+    pause.tv_nsec = (long)((interval - pause.tv_sec) * 1e9);
+    while (count != 0) {
+	nanosleep(&pause, NULL);
+	if (read_segment(segment, &now) < 0) {
+	    fprintf(stderr, "%s: the segment keeps changing, skipped\n", argv[0]);
+	    continue;
+	}
+	print_snapshot(&now, &prev, interval);
+	prev = now;
+	if (count > 0)
+	    count--;
+	/* The segment stays mapped after the program exits, stop then */
+	if (kill((pid_t)pid, 0) < 0) {
+	    printf("process %ld has exited\n", pid);
+	    break;
+	}
+    }
+    return 0;
+}